@@ -1,61 +1,268 @@
 #include "L1.h"
-#include <map>
 
 namespace L1 {
 	// Item methods
 
-	std::string Item::toString() const {
+	std::string Item::toString(const SymbolTable &symbols) const {
 		return "(unimplemented)";
 	}
 
-	// Register methods
-
-	std::map<std::string, RegisterID> strToRegId {
-		{ "rax", RegisterID::rax },
-		{ "rbx", RegisterID::rbx },
-		{ "rcx", RegisterID::rcx },
-		{ "rdx", RegisterID::rdx },
-		{ "rdi", RegisterID::rdi },
-		{ "rsi", RegisterID::rsi },
-		{ "r8", RegisterID::r8 },
-		{ "r9", RegisterID::r9 },
-		{ "r10", RegisterID::r10 },
-		{ "r11", RegisterID::r11 },
-		{ "r12", RegisterID::r12 },
-		{ "r13", RegisterID::r13 },
-		{ "r14", RegisterID::r14 },
-		{ "r15", RegisterID::r15 },
-		{ "rbp", RegisterID::rbp },
-		{ "rsp", RegisterID::rsp }
+	// RegisterID functions
+
+	static const char *register_names[] = {
+		"rax", "rbx", "rcx", "rdx", "rdi", "rsi", "r8", "r9",
+		"r10", "r11", "r12", "r13", "r14", "r15", "rbp", "rsp"
 	};
 
-	Register::Register(const std::string &id) : id {strToRegId[id]}, str {id} {}
+	std::string to_string(RegisterID id) {
+		return register_names[static_cast<int>(id)];
+	}
+
+	// RegisterClass functions
+
+	bool is_in_class(RegisterID id, RegisterClass c) {
+		switch (c) {
+			case RegisterClass::argument:
+				return id == RegisterID::rdi || id == RegisterID::rsi || id == RegisterID::rdx
+					|| id == RegisterID::rcx || id == RegisterID::r8 || id == RegisterID::r9;
+			case RegisterClass::writable: return id != RegisterID::rsp;
+			case RegisterClass::any: return true;
+			case RegisterClass::shift: return id == RegisterID::rcx;
+		}
+		return false;
+	}
+
+	// Operator functions
+
+	std::string to_string(Operator op) {
+		switch (op) {
+			case Operator::plus: return "+=";
+			case Operator::minus: return "-=";
+			case Operator::times: return "*=";
+			case Operator::bitwise_and: return "&=";
+			case Operator::lshift: return "<<=";
+			case Operator::rshift: return ">>=";
+			case Operator::lt: return "<";
+			case Operator::le: return "<=";
+			case Operator::eq: return "=";
+		}
+		return "?";
+	}
+
+	// RuntimeFunction functions
+
+	std::string to_string(RuntimeFunction function) {
+		switch (function) {
+			case RuntimeFunction::print: return "print";
+			case RuntimeFunction::input: return "input";
+			case RuntimeFunction::allocate: return "allocate";
+			case RuntimeFunction::tuple_error: return "tuple-error";
+			case RuntimeFunction::tensor_error: return "tensor-error";
+		}
+		return "?";
+	}
+
+	// indexed by RuntimeFunction
+	static const char *runtime_function_names[num_runtime_functions] = {
+		"print", "input", "allocate", "tuple_error", "tensor_error"
+	};
+
+	const char *runtime_function_name(RuntimeFunction function) {
+		return runtime_function_names[static_cast<int>(function)];
+	}
+
+	// Operand methods
+
+	Operand::Operand() : kind {OperandKind::none}, reg {RegisterID::rax}, value {0} {}
+
+	Operand Operand::make_register(RegisterID reg) {
+		Operand o;
+		o.kind = OperandKind::reg;
+		o.reg = reg;
+		return o;
+	}
+
+	Operand Operand::make_number(int64_t value) {
+		Operand o;
+		o.kind = OperandKind::number;
+		o.value = value;
+		return o;
+	}
+
+	Operand Operand::make_label(SymbolID symbol) {
+		Operand o;
+		o.kind = OperandKind::label;
+		o.symbol = symbol;
+		return o;
+	}
+
+	Operand Operand::make_function_name(SymbolID symbol) {
+		Operand o;
+		o.kind = OperandKind::function_name;
+		o.symbol = symbol;
+		return o;
+	}
+
+	Operand Operand::make_memory(RegisterID base, int64_t offset) {
+		Operand o;
+		o.kind = OperandKind::memory;
+		o.reg = base;
+		o.value = offset;
+		return o;
+	}
+
+	std::string Operand::toString(const SymbolTable &symbols) const {
+		switch (this->kind) {
+			case OperandKind::reg: return to_string(this->reg);
+			case OperandKind::number: return std::to_string(this->value);
+			case OperandKind::label: return ":" + symbols.name(this->symbol);
+			case OperandKind::function_name: return "@" + symbols.name(this->symbol);
+			case OperandKind::memory: return "mem " + to_string(this->reg) + " " + std::to_string(this->value);
+			case OperandKind::none: break;
+		}
+		return "(none)";
+	}
+
+	void Operand::remap_symbol(const std::vector<SymbolID> &new_ids) {
+		if (this->kind == OperandKind::label || this->kind == OperandKind::function_name) {
+			this->symbol = new_ids[this->symbol];
+		}
+	}
+
+	// Instruction methods
+
+	void Instruction::remap_symbols(const std::vector<SymbolID> &new_ids) {}
+
+	void Instruction_ret::accept(InstructionVisitor &visitor) {
+		visitor.visit(*this);
+	}
+
+	void Instruction_assignment::accept(InstructionVisitor &visitor) {
+		visitor.visit(*this);
+	}
+
+	void Instruction_arithmetic::accept(InstructionVisitor &visitor) {
+		visitor.visit(*this);
+	}
+
+	void Instruction_shift::accept(InstructionVisitor &visitor) {
+		visitor.visit(*this);
+	}
+
+	void Instruction_compare_assignment::accept(InstructionVisitor &visitor) {
+		visitor.visit(*this);
+	}
+
+	void Instruction_cjump::accept(InstructionVisitor &visitor) {
+		visitor.visit(*this);
+	}
+
+	void Instruction_label::accept(InstructionVisitor &visitor) {
+		visitor.visit(*this);
+	}
+
+	void Instruction_goto::accept(InstructionVisitor &visitor) {
+		visitor.visit(*this);
+	}
+
+	void Instruction_call::accept(InstructionVisitor &visitor) {
+		visitor.visit(*this);
+	}
+
+	void Instruction_call_runtime::accept(InstructionVisitor &visitor) {
+		visitor.visit(*this);
+	}
+
+	void Instruction_increment::accept(InstructionVisitor &visitor) {
+		visitor.visit(*this);
+	}
+
+	void Instruction_decrement::accept(InstructionVisitor &visitor) {
+		visitor.visit(*this);
+	}
+
+	void Instruction_lea::accept(InstructionVisitor &visitor) {
+		visitor.visit(*this);
+	}
+
+	void Instruction_assignment::remap_symbols(const std::vector<SymbolID> &new_ids) {
+		this->source.remap_symbol(new_ids);
+	}
+
+	void Instruction_cjump::remap_symbols(const std::vector<SymbolID> &new_ids) {
+		this->label.remap_symbol(new_ids);
+	}
 
-	std::string Register::toString() const {
-		return std::string("Register ") + this->str;
+	void Instruction_label::remap_symbols(const std::vector<SymbolID> &new_ids) {
+		this->label.remap_symbol(new_ids);
 	}
 
-	// Number methods
+	void Instruction_goto::remap_symbols(const std::vector<SymbolID> &new_ids) {
+		this->label.remap_symbol(new_ids);
+	}
+
+	void Instruction_call::remap_symbols(const std::vector<SymbolID> &new_ids) {
+		this->callee.remap_symbol(new_ids);
+	}
 
-	Number::Number(int64_t value) : value {value} {}
+	std::string Instruction_ret::toString(const SymbolTable &symbols) const {
+		return "return";
+	}
 
-	std::string Number::toString() const {
-		return std::string("Number ") + std::to_string(this->value);
+	std::string Instruction_assignment::toString(const SymbolTable &symbols) const {
+		return this->destination.toString(symbols) + " <- " + this->source.toString(symbols);
 	}
 
-	// Label methods
+	std::string Instruction_arithmetic::toString(const SymbolTable &symbols) const {
+		return this->destination.toString(symbols) + " " + to_string(this->op) + " " + this->source.toString(symbols);
+	}
 
-	Label::Label(const std::string &name) : name {name} {}
+	std::string Instruction_shift::toString(const SymbolTable &symbols) const {
+		return this->destination.toString(symbols) + " " + to_string(this->op) + " " + this->source.toString(symbols);
+	}
 
-	std::string Label::toString() const {
-		return std::string("Label :") + this->name;
+	std::string Instruction_compare_assignment::toString(const SymbolTable &symbols) const {
+		return this->destination.toString(symbols) + " <- " + this->lhs.toString(symbols) + " " + to_string(this->op) + " " + this->rhs.toString(symbols);
 	}
 
-	// FunctionName methods
+	std::string Instruction_cjump::toString(const SymbolTable &symbols) const {
+		return "cjump " + this->lhs.toString(symbols) + " " + to_string(this->op) + " " + this->rhs.toString(symbols) + " " + this->label.toString(symbols);
+	}
+
+	std::string Instruction_label::toString(const SymbolTable &symbols) const {
+		return this->label.toString(symbols);
+	}
+
+	std::string Instruction_goto::toString(const SymbolTable &symbols) const {
+		return "goto " + this->label.toString(symbols);
+	}
+
+	std::string Instruction_call::toString(const SymbolTable &symbols) const {
+		return "call " + this->callee.toString(symbols) + " " + std::to_string(this->num_arguments);
+	}
+
+	std::string Instruction_call_runtime::toString(const SymbolTable &symbols) const {
+		return "call " + to_string(this->function) + " " + std::to_string(this->num_arguments);
+	}
+
+	std::string Instruction_increment::toString(const SymbolTable &symbols) const {
+		return this->destination.toString(symbols) + "++";
+	}
+
+	std::string Instruction_decrement::toString(const SymbolTable &symbols) const {
+		return this->destination.toString(symbols) + "--";
+	}
+
+	std::string Instruction_lea::toString(const SymbolTable &symbols) const {
+		return this->destination.toString(symbols) + " @ " + this->base.toString(symbols) + " " + this->index.toString(symbols) + " " + std::to_string(this->scale);
+	}
 
-	FunctionName::FunctionName(const std::string &name) : name {name} {}
+	// Function methods
 
-	std::string FunctionName::toString() const {
-		return std::string("FunctionName @") + this->name;
+	void Function::remap_symbols(const std::vector<SymbolID> &new_ids) {
+		this->name = new_ids[this->name];
+		for (Instruction *i : this->instructions) {
+			i->remap_symbols(new_ids);
+		}
 	}
 }
@@ -2,6 +2,11 @@
 
 #include <vector>
 #include <string>
+#include <cstdint>
+#include <stdexcept>
+
+#include <arena.h>
+#include <symbol_table.h>
 
 namespace L1 {
 
@@ -24,72 +29,452 @@ namespace L1 {
 		rsp
 	};
 
+	std::string to_string(RegisterID id);
+
+	/*
+	 * Register classes of the grammar: "a" holds arguments, "w" can be
+	 * written (a plus rax, rbx, rbp, r10-r15), "x" is any register (w plus
+	 * rsp), and "sx" is the shift count register, rcx.
+	 */
+	enum struct RegisterClass : uint8_t {
+		argument,
+		writable,
+		any,
+		shift
+	};
+
+	bool is_in_class(RegisterID id, RegisterClass c);
+
 	// Every component of the AST is-a Item
 	struct Item {
-		virtual std::string toString() const;
+		virtual std::string toString(const SymbolTable &symbols) const;
+	};
+
+	enum struct OperandKind : uint8_t {
+		none,
+		reg,
+		number,
+		label,
+		function_name,
+		memory // "mem x M"; uses both `reg` (x) and `value` (M)
 	};
 
-	struct Register : Item {
-		RegisterID id;
-		std::string str; // TODO remove
+	/*
+	 * Operands are small values stored inline in the instructions: a kind tag
+	 * plus a payload, 16 bytes in total.
+	 */
+	struct Operand {
+		OperandKind kind;
+		RegisterID reg;
+		union {
+			int64_t value;
+			SymbolID symbol; // label or function name
+		};
+
+		Operand();
+
+		static Operand make_register(RegisterID reg);
+		static Operand make_number(int64_t value);
+		static Operand make_label(SymbolID symbol);
+		static Operand make_function_name(SymbolID symbol);
+		static Operand make_memory(RegisterID base, int64_t offset);
 
-		Register(const std::string &id);
+		std::string toString(const SymbolTable &symbols) const;
 
-		virtual std::string toString() const override;
+		// for labels and function names, replaces `symbol` with new_ids[symbol]
+		void remap_symbol(const std::vector<SymbolID> &new_ids);
 	};
 
-	struct Number : Item {
-		int64_t value;
+	static_assert(sizeof(Operand) == 16, "operands must stay 16 bytes");
+
+	/*
+	 * Operand shapes: the kinds of Operand as separate types, with the
+	 * register class of the position they appear in. Instructions hand out
+	 * their operands as shapes (see with_operands), so passes can have one
+	 * overload per form of an instruction, chosen at compile time, instead
+	 * of switching on OperandKind.
+	 */
+	namespace shape {
+		template <RegisterClass C>
+		struct Register {
+			RegisterID id;
+
+			static bool matches(const Operand &o) {
+				return o.kind == OperandKind::reg && is_in_class(o.reg, C);
+			}
+
+			static Register from(const Operand &o) {
+				return {o.reg};
+			}
+		};
+
+		struct Number {
+			int64_t value;
+
+			static bool matches(const Operand &o) {
+				return o.kind == OperandKind::number;
+			}
+
+			static Number from(const Operand &o) {
+				return {o.value};
+			}
+		};
+
+		// "mem x M"
+		struct Memory {
+			RegisterID base;
+			int64_t offset;
 
-		Number(int64_t value);
+			static bool matches(const Operand &o) {
+				return o.kind == OperandKind::memory && is_in_class(o.reg, RegisterClass::any);
+			}
 
-		virtual std::string toString() const override;
+			static Memory from(const Operand &o) {
+				return {o.reg, o.value};
+			}
+		};
+
+		// a label or a function name
+		struct Label {
+			SymbolID symbol;
+
+			static bool matches(const Operand &o) {
+				return o.kind == OperandKind::label || o.kind == OperandKind::function_name;
+			}
+
+			static Label from(const Operand &o) {
+				return {o.symbol};
+			}
+		};
+
+		using w = Register<RegisterClass::writable>;
+		using x = Register<RegisterClass::any>;
+		using sx = Register<RegisterClass::shift>;
+	}
+
+	/*
+	 * Calls f with `o` as the first of `Shapes` that it matches. Throws if it
+	 * matches none, which means the instruction doesn't follow the grammar.
+	 */
+	template <typename... Shapes, typename F>
+	void with_shape(const Operand &o, F &&f) {
+		bool matched = ((Shapes::matches(o) ? (f(Shapes::from(o)), true) : false) || ...);
+		if (!matched) {
+			throw std::logic_error("operand doesn't fit the grammar of its instruction");
+		}
+	}
+
+	enum struct Operator {
+		plus,
+		minus,
+		times,
+		bitwise_and,
+		lshift,
+		rshift,
+		lt,
+		le,
+		eq
 	};
 
-	struct Label : Item {
-		std::string name;
+	std::string to_string(Operator op);
 
-		Label(const std::string &name);
+	// whether the comparison `lhs op rhs` holds; false for the other operators
+	inline bool compare_constants(Operator op, int64_t lhs, int64_t rhs) {
+		switch (op) {
+			case Operator::lt: return lhs < rhs;
+			case Operator::le: return lhs <= rhs;
+			case Operator::eq: return lhs == rhs;
+			default: return false;
+		}
+	}
 
-		virtual std::string toString() const override;
+	enum struct RuntimeFunction {
+		print,
+		input,
+		allocate,
+		tuple_error,
+		tensor_error
 	};
 
-	struct FunctionName : Item {
-		std::string name;
+	std::string to_string(RuntimeFunction function);
+
+	// the C function of the runtime that implements `function`
+	const char *runtime_function_name(RuntimeFunction function);
 
-		FunctionName(const std::string &name);
+	constexpr int num_runtime_functions = 5;
 
-		virtual std::string toString() const override;
+	/*
+	 * Instruction visitor.
+	 * Passes that treat each kind of instruction differently implement this
+	 * and call Instruction::accept.
+	 */
+	struct Instruction_ret;
+	struct Instruction_assignment;
+	struct Instruction_arithmetic;
+	struct Instruction_shift;
+	struct Instruction_compare_assignment;
+	struct Instruction_cjump;
+	struct Instruction_label;
+	struct Instruction_goto;
+	struct Instruction_call;
+	struct Instruction_call_runtime;
+	struct Instruction_increment;
+	struct Instruction_decrement;
+	struct Instruction_lea;
+
+	struct InstructionVisitor {
+		virtual void visit(Instruction_ret &i) = 0;
+		virtual void visit(Instruction_assignment &i) = 0;
+		virtual void visit(Instruction_arithmetic &i) = 0;
+		virtual void visit(Instruction_shift &i) = 0;
+		virtual void visit(Instruction_compare_assignment &i) = 0;
+		virtual void visit(Instruction_cjump &i) = 0;
+		virtual void visit(Instruction_label &i) = 0;
+		virtual void visit(Instruction_goto &i) = 0;
+		virtual void visit(Instruction_call &i) = 0;
+		virtual void visit(Instruction_call_runtime &i) = 0;
+		virtual void visit(Instruction_increment &i) = 0;
+		virtual void visit(Instruction_decrement &i) = 0;
+		virtual void visit(Instruction_lea &i) = 0;
 	};
 
 	/*
 	 * Instruction interface.
 	 */
-	struct Instruction : Item {};
+	struct Instruction : Item {
+		virtual void accept(InstructionVisitor &visitor) = 0;
+
+		/*
+		 * Moves the instruction to another symbol table by replacing every
+		 * SymbolID in it with new_ids[id].
+		 */
+		virtual void remap_symbols(const std::vector<SymbolID> &new_ids);
+	};
 
 	/*
 	 * Instructions.
 	 */
-	struct Instruction_ret : Instruction {};
+	struct Instruction_ret : Instruction {
+		virtual std::string toString(const SymbolTable &symbols) const override;
+		virtual void accept(InstructionVisitor &visitor) override;
+	};
 
+	// "w <- s", "w <- mem x M", and "mem x M <- s"
 	struct Instruction_assignment : Instruction {
-		Item *source;
-		Item *destination;
+		Operand source;
+		Operand destination;
+
+		// f(destination, source) for every form
+		template <typename F>
+		void with_operands(F &&f) const {
+			if (this->destination.kind == OperandKind::memory) {
+				with_shape<shape::Memory>(this->destination, [&](auto d) {
+					with_shape<shape::x, shape::Number, shape::Label>(this->source, [&](auto s) { f(d, s); });
+				});
+				return;
+			}
+			with_shape<shape::w>(this->destination, [&](auto d) {
+				with_shape<shape::x, shape::Number, shape::Label, shape::Memory>(this->source, [&](auto s) { f(d, s); });
+			});
+		}
+
+		virtual std::string toString(const SymbolTable &symbols) const override;
+		virtual void remap_symbols(const std::vector<SymbolID> &new_ids) override;
+		virtual void accept(InstructionVisitor &visitor) override;
+	};
+
+	// "w aop t", "mem x M += t", "w += mem x M", etc.
+	struct Instruction_arithmetic : Instruction {
+		Operator op;
+		Operand source;
+		Operand destination;
+
+		// f(destination, source) for every form
+		template <typename F>
+		void with_operands(F &&f) const {
+			if (this->destination.kind == OperandKind::memory) {
+				with_shape<shape::Memory>(this->destination, [&](auto d) {
+					with_shape<shape::x, shape::Number>(this->source, [&](auto s) { f(d, s); });
+				});
+				return;
+			}
+			with_shape<shape::w>(this->destination, [&](auto d) {
+				with_shape<shape::x, shape::Number, shape::Memory>(this->source, [&](auto s) { f(d, s); });
+			});
+		}
+
+		virtual std::string toString(const SymbolTable &symbols) const override;
+		virtual void accept(InstructionVisitor &visitor) override;
+	};
+
+	// "w sop sx" and "w sop N"
+	struct Instruction_shift : Instruction {
+		Operator op;
+		Operand source;
+		Operand destination;
+
+		// f(destination, source) for every form
+		template <typename F>
+		void with_operands(F &&f) const {
+			with_shape<shape::w>(this->destination, [&](auto d) {
+				with_shape<shape::sx, shape::Number>(this->source, [&](auto s) { f(d, s); });
+			});
+		}
+
+		virtual std::string toString(const SymbolTable &symbols) const override;
+		virtual void accept(InstructionVisitor &visitor) override;
+	};
+
+	// "w <- t cmp t"
+	struct Instruction_compare_assignment : Instruction {
+		Operator op;
+		Operand lhs;
+		Operand rhs;
+		Operand destination;
+
+		// f(destination, lhs, rhs) for every form
+		template <typename F>
+		void with_operands(F &&f) const {
+			with_shape<shape::w>(this->destination, [&](auto d) {
+				with_shape<shape::x, shape::Number>(this->lhs, [&](auto l) {
+					with_shape<shape::x, shape::Number>(this->rhs, [&](auto r) { f(d, l, r); });
+				});
+			});
+		}
+
+		virtual std::string toString(const SymbolTable &symbols) const override;
+		virtual void accept(InstructionVisitor &visitor) override;
+	};
+
+	// "cjump t cmp t label"
+	struct Instruction_cjump : Instruction {
+		Operator op;
+		Operand lhs;
+		Operand rhs;
+		Operand label;
+
+		// f(lhs, rhs) for every form
+		template <typename F>
+		void with_operands(F &&f) const {
+			with_shape<shape::x, shape::Number>(this->lhs, [&](auto l) {
+				with_shape<shape::x, shape::Number>(this->rhs, [&](auto r) { f(l, r); });
+			});
+		}
+
+		virtual std::string toString(const SymbolTable &symbols) const override;
+		virtual void remap_symbols(const std::vector<SymbolID> &new_ids) override;
+		virtual void accept(InstructionVisitor &visitor) override;
+	};
+
+	struct Instruction_label : Instruction {
+		Operand label;
+
+		virtual std::string toString(const SymbolTable &symbols) const override;
+		virtual void remap_symbols(const std::vector<SymbolID> &new_ids) override;
+		virtual void accept(InstructionVisitor &visitor) override;
+	};
+
+	struct Instruction_goto : Instruction {
+		Operand label;
+
+		virtual std::string toString(const SymbolTable &symbols) const override;
+		virtual void remap_symbols(const std::vector<SymbolID> &new_ids) override;
+		virtual void accept(InstructionVisitor &visitor) override;
+	};
+
+	// "call u N"
+	struct Instruction_call : Instruction {
+		Operand callee;
+		int64_t num_arguments;
+
+		// f(callee) for every form
+		template <typename F>
+		void with_operands(F &&f) const {
+			with_shape<shape::w, shape::Label>(this->callee, f);
+		}
+
+		virtual std::string toString(const SymbolTable &symbols) const override;
+		virtual void remap_symbols(const std::vector<SymbolID> &new_ids) override;
+		virtual void accept(InstructionVisitor &visitor) override;
+	};
+
+	// "call print 1", "call input 0", etc.
+	struct Instruction_call_runtime : Instruction {
+		RuntimeFunction function;
+		int64_t num_arguments;
+
+		virtual std::string toString(const SymbolTable &symbols) const override;
+		virtual void accept(InstructionVisitor &visitor) override;
+	};
+
+	struct Instruction_increment : Instruction {
+		Operand destination;
+
+		virtual std::string toString(const SymbolTable &symbols) const override;
+		virtual void accept(InstructionVisitor &visitor) override;
+	};
+
+	struct Instruction_decrement : Instruction {
+		Operand destination;
+
+		virtual std::string toString(const SymbolTable &symbols) const override;
+		virtual void accept(InstructionVisitor &visitor) override;
+	};
+
+	// "w @ w w E"
+	struct Instruction_lea : Instruction {
+		Operand destination;
+		Operand base;
+		Operand index;
+		int64_t scale;
+
+		virtual std::string toString(const SymbolTable &symbols) const override;
+		virtual void accept(InstructionVisitor &visitor) override;
 	};
 
 	/*
 	 * Function.
+	 * Functions and their instructions are allocated in an arena (usually
+	 * the Program's), which owns them; the pointers here never own anything.
 	 */
 	struct Function : Item {
-		std::string name;
+		SymbolID name;
 		int64_t num_arguments;
 		int64_t num_locals;
 		// TODO consider changing to value type instead of ptr type
 		std::vector<Instruction *> instructions;
+
+		Function() = default;
+		Function(const Function &) = delete;
+		Function &operator=(const Function &) = delete;
+
+		void remap_symbols(const std::vector<SymbolID> &new_ids);
 	};
 
+	// stack space released by "return" and reserved by "call u N", in words
+	inline int64_t stack_arguments(int64_t num_arguments) {
+		return num_arguments > 6 ? num_arguments - 6 : 0;
+	}
+
+	/*
+	 * Program.
+	 * Every Item reachable from a Program is allocated in its arena, so the
+	 * whole AST is freed at once when the Program is destroyed. Labels and
+	 * function names are interned in its symbol table.
+	 *
+	 * A Program is move-only: it is returned by move from the parser, and
+	 * passes take it by const or mutable reference.
+	 */
 	struct Program {
-		std::string entryPointLabel;
+		Arena arena;
+		SymbolTable symbols;
+		SymbolID entryPointLabel;
 		std::vector<Function *> functions;
+
+		Program() = default;
+		Program(const Program &) = delete;
+		Program &operator=(const Program &) = delete;
+		Program(Program &&) = default;
+		Program &operator=(Program &&) = default;
 	};
 }
@@ -0,0 +1,101 @@
+#include <arena.h>
+#include <cstdint>
+
+namespace L1 {
+	// size of a regular block; requests larger than this get a block of their own
+	static const std::size_t block_size = 64 * 1024;
+
+	Arena::Arena() : cursor {nullptr}, limit {nullptr}, bytes {0} {}
+
+	Arena::Arena(Arena &&other) noexcept :
+		blocks {std::move(other.blocks)},
+		finalizers {std::move(other.finalizers)},
+		cursor {other.cursor},
+		limit {other.limit},
+		bytes {other.bytes}
+	{
+		other.blocks.clear();
+		other.finalizers.clear();
+		other.cursor = nullptr;
+		other.limit = nullptr;
+		other.bytes = 0;
+	}
+
+	Arena &Arena::operator=(Arena &&other) noexcept {
+		if (this != &other) {
+			this->release();
+			this->blocks = std::move(other.blocks);
+			this->finalizers = std::move(other.finalizers);
+			this->cursor = other.cursor;
+			this->limit = other.limit;
+			this->bytes = other.bytes;
+			other.blocks.clear();
+			other.finalizers.clear();
+			other.cursor = nullptr;
+			other.limit = nullptr;
+			other.bytes = 0;
+		}
+		return *this;
+	}
+
+	Arena::~Arena() {
+		this->release();
+	}
+
+	void Arena::release() {
+		for (auto it = this->finalizers.rbegin(); it != this->finalizers.rend(); ++it) {
+			it->destroy(it->object);
+		}
+		this->finalizers.clear();
+		this->blocks.clear();
+		this->cursor = nullptr;
+		this->limit = nullptr;
+		this->bytes = 0;
+	}
+
+	void Arena::grow(std::size_t min_size) {
+		std::size_t size = min_size > block_size ? min_size : block_size;
+		this->blocks.emplace_back(new char[size]);
+		this->cursor = this->blocks.back().get();
+		this->limit = this->cursor + size;
+	}
+
+	void *Arena::allocate(std::size_t size, std::size_t alignment) {
+		auto align_up = [alignment](char *p) {
+			std::uintptr_t address = reinterpret_cast<std::uintptr_t>(p);
+			return reinterpret_cast<char *>((address + alignment - 1) & ~(std::uintptr_t)(alignment - 1));
+		};
+
+		char *start = this->cursor ? align_up(this->cursor) : nullptr;
+		if (!start || start + size > this->limit) {
+			this->grow(size + alignment);
+			start = align_up(this->cursor);
+		}
+		this->cursor = start + size;
+		this->bytes += size;
+		return start;
+	}
+
+	std::size_t Arena::bytes_allocated() const {
+		return this->bytes;
+	}
+
+	void Arena::adopt(Arena &&other) {
+		if (this == &other) {
+			return;
+		}
+		// our current block stays last, so allocation continues where it was
+		this->blocks.insert(
+			this->blocks.begin(),
+			std::make_move_iterator(other.blocks.begin()),
+			std::make_move_iterator(other.blocks.end())
+		);
+		this->finalizers.insert(this->finalizers.end(), other.finalizers.begin(), other.finalizers.end());
+		this->bytes += other.bytes;
+		other.blocks.clear();
+		other.finalizers.clear();
+		other.cursor = nullptr;
+		other.limit = nullptr;
+		other.bytes = 0;
+	}
+}
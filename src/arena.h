@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace L1 {
+
+	/*
+	 * Bump allocator that owns the nodes of an AST.
+	 *
+	 * Objects are carved out of large blocks and are never freed individually;
+	 * everything is released in one step when the arena is destroyed. Objects
+	 * that are not trivially destructible get their destructor run at that
+	 * point, in reverse order of construction.
+	 */
+	class Arena {
+		public:
+
+		Arena();
+		Arena(const Arena &) = delete;
+		Arena &operator=(const Arena &) = delete;
+		Arena(Arena &&other) noexcept;
+		Arena &operator=(Arena &&other) noexcept;
+		~Arena();
+
+		template<typename T, typename... Args>
+		T *make(Args &&... args) {
+			void *memory = this->allocate(sizeof(T), alignof(T));
+			T *object = new (memory) T(std::forward<Args>(args)...);
+			if constexpr (!std::is_trivially_destructible_v<T>) {
+				this->finalizers.push_back({
+					object,
+					[](void *o) { static_cast<T *>(o)->~T(); }
+				});
+			}
+			return object;
+		}
+
+		void *allocate(std::size_t size, std::size_t alignment);
+
+		// total number of bytes handed out so far (excluding padding)
+		std::size_t bytes_allocated() const;
+
+		/*
+		 * Takes ownership of everything allocated in `other`, which is left
+		 * empty. Objects from both arenas stay where they are and are released
+		 * together with this arena.
+		 */
+		void adopt(Arena &&other);
+
+		private:
+
+		struct Finalizer {
+			void *object;
+			void (*destroy)(void *);
+		};
+
+		void release();
+		void grow(std::size_t min_size);
+
+		std::vector<std::unique_ptr<char[]>> blocks;
+		std::vector<Finalizer> finalizers;
+		char *cursor;
+		char *limit;
+		std::size_t bytes;
+	};
+}
@@ -0,0 +1,223 @@
+#include <algorithm>
+
+#include <block_layout.h>
+
+namespace L1 {
+	/*
+	 * The blocks that can only go on to tuple-error or tensor-error: the
+	 * ones that end in either call, and the ones whose successors all can
+	 * only go on to them.
+	 */
+	static std::vector<bool> error_paths(const Function &f, const ControlFlowGraph &cfg) {
+		std::size_t num_blocks = cfg.blocks.size();
+		std::vector<bool> error(num_blocks, false);
+		for (std::size_t b = 0; b < num_blocks; b++) {
+			auto call = dynamic_cast<const Instruction_call_runtime *>(f.instructions[cfg.blocks[b].end - 1]);
+			error[b] = call && (call->function == RuntimeFunction::tuple_error || call->function == RuntimeFunction::tensor_error);
+		}
+
+		// backward from the error calls; a cycle never gets in, since something has to leave it
+		std::vector<std::size_t> order = cfg.reverse_postorder();
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			for (auto b = order.rbegin(); b != order.rend(); b++) {
+				const BasicBlock &block = cfg.blocks[*b];
+				if (error[*b] || block.leaves_function || block.successors.empty()) {
+					continue;
+				}
+				bool all = std::all_of(block.successors.begin(), block.successors.end(), [&](std::size_t s) { return error[s]; });
+				if (all) {
+					error[*b] = true;
+					changed = true;
+				}
+			}
+		}
+		return error;
+	}
+
+	// a block that is only a goto to a block of the function, and has no label to jump to it by
+	static bool lone_goto(const Function &f, const ControlFlowGraph &cfg, std::size_t b) {
+		const BasicBlock &block = cfg.blocks[b];
+		return block.end - block.begin == 1
+			&& dynamic_cast<const Instruction_goto *>(f.instructions[block.begin])
+			&& block.successors.size() == 1;
+	}
+
+	JumpTarget block_target(const Function &f, const ControlFlowGraph &cfg, std::size_t b) {
+		auto label = dynamic_cast<const Instruction_label *>(f.instructions[cfg.blocks[b].begin]);
+		return {label ? &label->label : nullptr, b};
+	}
+
+	// how many times control went from block p to block s
+	static uint64_t edge_count(const ControlFlowGraph &cfg, const FunctionProfile &profile, std::size_t p, std::size_t s) {
+		const BasicBlock &block = cfg.blocks[p];
+		uint64_t count = 0;
+		if (block.falls_through && s == p + 1) {
+			count += profile.fell_through[p];
+		}
+		// the first successor is where the block jumps to, if it jumps to a block of the function
+		if (!block.leaves_function && !block.successors.empty() && block.successors[0] == s) {
+			count += profile.blocks[p] - profile.fell_through[p];
+		}
+		return count;
+	}
+
+	// BlockLayout methods
+
+	BlockLayout::BlockLayout(const Function &f, const ControlFlowGraph &cfg, const FunctionProfile *profile) :
+		exits(cfg.blocks.size(), Exit::as_written),
+		falls_into(cfg.blocks.size(), none),
+		aligned(cfg.blocks.size(), false)
+	{
+		std::size_t num_blocks = cfg.blocks.size();
+		if (num_blocks == 0) {
+			return;
+		}
+		this->order.reserve(num_blocks);
+
+		// lone gotos after a cjump are never written, so nothing is placed after them
+		std::vector<bool> placed(num_blocks, false);
+		for (std::size_t b = 0; b + 1 < num_blocks; b++) {
+			if (!cfg.blocks[b].falls_through) {
+				continue;
+			}
+			if (cfg.blocks[b].successors.size() == 2 && lone_goto(f, cfg, b + 1)) {
+				this->falls_into[b] = cfg.blocks[b + 1].successors[0];
+				placed[b + 1] = true;
+			} else {
+				this->falls_into[b] = b + 1;
+			}
+		}
+
+		// how often each block runs, guessed as 8 times as often for every loop around it
+		Dominators dominators(cfg);
+		LoopNest loops(cfg, dominators);
+		std::vector<bool> cold = error_paths(f, cfg);
+		std::vector<uint64_t> weights(num_blocks, 0);
+		for (std::size_t b = 0; b < num_blocks; b++) {
+			if (profile) {
+				cold[b] = cold[b] || profile->blocks[b] == 0;
+			} else {
+				weights[b] = cold[b] ? 0 : uint64_t(1) << (3 * std::min<uint32_t>(loops.depth[b], 20));
+			}
+		}
+		cold[0] = false;
+
+		// how likely it is that block b goes on to block s
+		auto weight = [&](std::size_t b, std::size_t s) {
+			if (!profile) {
+				return weights[s];
+			}
+			uint64_t count = edge_count(cfg, *profile, b, s);
+			if (s == this->falls_into[b] && s != b + 1) {
+				// through the lone goto
+				count += profile->fell_through[b];
+			}
+			return count;
+		};
+
+		bool last_pinned = num_blocks > 1 && cfg.blocks[num_blocks - 1].falls_through && !placed[num_blocks - 1];
+		if (last_pinned) {
+			placed[num_blocks - 1] = true;
+		}
+
+		// chains of hot blocks, each block followed by its heaviest successor not placed yet
+		for (std::size_t seed = 0; seed < num_blocks; seed++) {
+			std::size_t b = seed;
+			while (b != none && !placed[b] && !cold[b]) {
+				placed[b] = true;
+				this->order.push_back(b);
+				const BasicBlock &block = cfg.blocks[b];
+				std::size_t next = none;
+				uint64_t next_weight = 0;
+				auto consider = [&](std::size_t s) {
+					if (placed[s] || cold[s]) {
+						return;
+					}
+					// on a tie, keep falling into the same block as before
+					uint64_t w = weight(b, s);
+					if (next == none || w > next_weight || (w == next_weight && s == this->falls_into[b])) {
+						next = s;
+						next_weight = w;
+					}
+				};
+				for (std::size_t s : block.successors) {
+					consider(s);
+				}
+				if (this->falls_into[b] != none) {
+					consider(this->falls_into[b]);
+				}
+				b = next;
+			}
+		}
+		for (std::size_t b = 0; b < num_blocks; b++) {
+			if (!placed[b]) {
+				this->order.push_back(b);
+			}
+		}
+		if (last_pinned) {
+			this->order.push_back(num_blocks - 1);
+		}
+
+		// how each block leaves for the one after it
+		for (std::size_t p = 0; p < this->order.size(); p++) {
+			std::size_t b = this->order[p];
+			std::size_t next = p + 1 < this->order.size() ? this->order[p + 1] : none;
+			const BasicBlock &block = cfg.blocks[b];
+			if (this->falls_into[b] == none) {
+				// only a goto has a single successor and doesn't fall through
+				if (!block.falls_through && block.successors.size() == 1 && block.successors[0] == next) {
+					this->exits[b] = Exit::omit_goto;
+				}
+				continue;
+			}
+			if (next == this->falls_into[b]) {
+				continue;
+			}
+			// only a cjump has a successor besides the block after it
+			this->exits[b] = block.successors.size() == 2 && block.successors[0] == next ? Exit::invert : Exit::jump;
+		}
+
+		if (!profile) {
+			return;
+		}
+		for (const Loop &loop : loops.loops) {
+			uint64_t entries = 0;
+			for (std::size_t p : cfg.blocks[loop.header].predecessors) {
+				if (!std::binary_search(loop.blocks.begin(), loop.blocks.end(), p)) {
+					entries += edge_count(cfg, *profile, p, loop.header);
+				}
+			}
+			// the entry block starts the function, which is where calls come in
+			this->aligned[loop.header] = loop.header != 0 && profile->blocks[loop.header] >= 8 * std::max<uint64_t>(entries, 1);
+		}
+	}
+
+	void BlockLayout::write(const Function &f, const ControlFlowGraph &cfg, CompareBranchFinder &compare_branches, BlockSelector &selector) const {
+		for (std::size_t b : this->order) {
+			const BasicBlock &block = cfg.blocks[b];
+			Exit exit = this->exits[b];
+			selector.start_block(b, this->aligned[b], this->jumped_into(b) && !block_target(f, cfg, b).label);
+			for (std::size_t k = block.begin; k < block.end; k++) {
+				bool last = k + 1 == block.end;
+				CompareBranch branch;
+				if (compare_branches.find(k, branch)) {
+					if (k + 2 == block.end && exit == Exit::invert) {
+						selector.compare_branch(branch, true, block_target(f, cfg, this->falls_into[b]));
+					} else {
+						selector.compare_branch(branch, false, {&branch.cjump->label, 0});
+					}
+					k++;
+				} else if (last && exit == Exit::invert) {
+					selector.cjump(*static_cast<const Instruction_cjump *>(f.instructions[k]), true, block_target(f, cfg, this->falls_into[b]));
+				} else if (!last || exit != Exit::omit_goto) {
+					f.instructions[k]->accept(selector);
+				}
+			}
+			if (exit == Exit::jump) {
+				selector.jump(block_target(f, cfg, this->falls_into[b]));
+			}
+		}
+	}
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <L1.h>
+#include <cfg.h>
+#include <compare_branch.h>
+#include <profile.h>
+
+namespace L1 {
+	/*
+	 * The order the code generators write the blocks of a function in.
+	 *
+	 * Each block is followed by the successor it most likely goes on to, so
+	 * the likely way out of a branch falls through. Without a profile the
+	 * guess is that blocks nested deeper in loops run more often, and that
+	 * blocks that can only end in tuple-error or tensor-error almost never
+	 * run; those go after the rest of the function, in their original order.
+	 *
+	 * Control still only leaves a block the way it did: a block that no
+	 * longer comes right before the block it falls into jumps there. A
+	 * cjump followed by a lone goto (with no label of its own) is a branch
+	 * between the two targets, and the goto is never written. The last
+	 * block stays last if it runs past the end of the function.
+	 */
+	/*
+	 * Where a jump goes: an L1 label, or, for a block that doesn't start
+	 * with one, the block, which each code generator names its own way.
+	 */
+	struct JumpTarget {
+		const Operand *label;
+		std::size_t block;
+	};
+
+	// a jump to the start of block b
+	JumpTarget block_target(const Function &f, const ControlFlowGraph &cfg, std::size_t b);
+
+	/*
+	 * What a code generator's instruction selector does besides visiting
+	 * instructions, for BlockLayout::write.
+	 */
+	struct BlockSelector : public InstructionVisitor {
+		/*
+		 * Block b starts here, at a 16-byte boundary if `aligned`.
+		 * `needs_label` if it has no L1 label but is jumped to.
+		 */
+		virtual void start_block(std::size_t b, bool aligned, bool needs_label) = 0;
+
+		// a cjump that goes to `target` when its condition holds or, if `negate`, when it doesn't
+		virtual void cjump(const Instruction_cjump &i, bool negate, const JumpTarget &target) = 0;
+
+		// a CompareBranch whose jump goes to `target`, negated if `negate`
+		virtual void compare_branch(const CompareBranch &branch, bool negate, const JumpTarget &target) = 0;
+
+		virtual void jump(const JumpTarget &target) = 0;
+	};
+
+	struct BlockLayout {
+		static constexpr std::size_t none = SIZE_MAX;
+
+		// what the code generators write at the end of a block
+		enum struct Exit : uint8_t {
+			// its last instruction, as it is
+			as_written,
+			// its last instruction, then a jump to the block it falls into
+			jump,
+			/*
+			 * Its last instruction is a cjump to the next block in the layout:
+			 * jump to the block it falls into when the condition doesn't hold
+			 * instead.
+			 */
+			invert,
+			// its last instruction is a goto to the next block in the layout, which is left out
+			omit_goto
+		};
+
+		// every block of the ControlFlowGraph but the lone gotos, in the order to write them in
+		std::vector<std::size_t> order;
+
+		// by block
+		std::vector<Exit> exits;
+
+		/*
+		 * By block, where control goes when the block doesn't jump: the next
+		 * block in the function, or the target of its goto if that is a lone
+		 * goto. none if the block never falls through.
+		 */
+		std::vector<std::size_t> falls_into;
+
+		/*
+		 * By block, whether to start it at a 16-byte boundary. Only with a
+		 * profile: the headers of loops that went around at least 8 times
+		 * for every time they were entered.
+		 */
+		std::vector<bool> aligned;
+
+		/*
+		 * `profile`, if given, replaces the guesses: each block is followed
+		 * by the successor it went on to most often, and blocks that never
+		 * ran go last.
+		 */
+		BlockLayout(const Function &f, const ControlFlowGraph &cfg, const FunctionProfile *profile = nullptr);
+
+		/*
+		 * Whether block b is jumped to by the block before it in the
+		 * function, which is the only way into a block without a label.
+		 */
+		bool jumped_into(std::size_t b) const {
+			return b > 0 && this->falls_into[b - 1] == b && (this->exits[b - 1] == Exit::jump || this->exits[b - 1] == Exit::invert);
+		}
+
+		/*
+		 * Hands the blocks of f to `selector` in order, with the exit of
+		 * each one, and the compare-branch pairs `compare_branches` finds.
+		 */
+		void write(const Function &f, const ControlFlowGraph &cfg, CompareBranchFinder &compare_branches, BlockSelector &selector) const;
+	};
+}
@@ -0,0 +1,605 @@
+#include <algorithm>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include <bytecode_interpreter.h>
+#include <runtime.h>
+
+namespace L1 {
+	using Opcode = BytecodeProgram::Opcode;
+	using Bytecode = BytecodeProgram::Bytecode;
+
+	// the interpreted stack, in words; as big as a default native stack
+	static const std::size_t stack_size = 1 << 20;
+
+	static uint8_t index(RegisterID r) {
+		return static_cast<uint8_t>(r);
+	}
+
+	template <RegisterClass C>
+	static uint8_t index(shape::Register<C> r) {
+		return index(r.id);
+	}
+
+	/*
+	 * Lowers the body of one function to bytecode; the same choices as the
+	 * machine code selector, one bytecode instruction per x86 instruction.
+	 */
+	class BytecodeSelector : public InstructionVisitor {
+		public:
+
+		enum struct ReferenceKind {
+			target,
+			value
+		};
+
+		// the `target` or `value` of code[index] must point at `symbol`
+		struct LabelReference {
+			std::size_t index;
+			SymbolID symbol;
+			ReferenceKind kind;
+		};
+
+		BytecodeSelector(std::vector<Bytecode> &code, std::vector<int64_t> &symbol_indices, std::vector<LabelReference> &label_references, const SymbolTable &symbols) :
+			code {code},
+			symbol_indices {symbol_indices},
+			label_references {label_references},
+			symbols {symbols},
+			frame_size {0}
+		{}
+
+		// "go": stores the address of a halt as the return address and calls the entry point
+		void begin(SymbolID entryPointLabel) {
+			this->emit(Opcode::store_i, index(RegisterID::rsp), 0, 0, -8);
+			this->emit(Opcode::call, 0, 0, 0, 8);
+			this->reference(entryPointLabel, ReferenceKind::target);
+			this->emit(Opcode::halt);
+		}
+
+		void add_function(const Function &f) {
+			this->define(f.name);
+			this->frame_size = 8 * (f.num_locals + stack_arguments(f.num_arguments));
+			if (f.num_locals > 0) {
+				this->emit(Opcode::sub_ri, index(RegisterID::rsp), 0, 0, 8 * f.num_locals);
+			}
+			for (Instruction *i : f.instructions) {
+				i->accept(*this);
+			}
+		}
+
+		virtual void visit(Instruction_ret &i) override {
+			this->emit(Opcode::ret, 0, 0, 0, this->frame_size);
+		}
+
+		virtual void visit(Instruction_assignment &i) override {
+			i.with_operands([this](auto d, auto s) { this->assign(d, s); });
+		}
+
+		virtual void visit(Instruction_arithmetic &i) override {
+			i.with_operands([this, &i](auto d, auto s) { this->arithmetic(i.op, d, s); });
+		}
+
+		virtual void visit(Instruction_shift &i) override {
+			bool left = i.op == Operator::lshift;
+			i.with_operands([this, left](auto d, auto s) { this->shift(left, d, s); });
+		}
+
+		virtual void visit(Instruction_compare_assignment &i) override {
+			i.with_operands([this, &i](auto d, auto lhs, auto rhs) {
+				if constexpr (std::is_same_v<decltype(lhs), shape::Number> && std::is_same_v<decltype(rhs), shape::Number>) {
+					this->emit(Opcode::mov_ri, index(d)).value = compare_constants(i.op, lhs.value, rhs.value);
+				} else {
+					this->compare(this->comparison(i.op, Opcode::lt_rr, Opcode::le_rr, Opcode::eq_rr), this->comparison(i.op, Opcode::lt_ri, Opcode::le_ri, Opcode::eq_ri), this->comparison(i.op, Opcode::gt_ri, Opcode::ge_ri, Opcode::eq_ri), index(d), lhs, rhs);
+				}
+			});
+		}
+
+		virtual void visit(Instruction_cjump &i) override {
+			i.with_operands([this, &i](auto lhs, auto rhs) {
+				if constexpr (std::is_same_v<decltype(lhs), shape::Number> && std::is_same_v<decltype(rhs), shape::Number>) {
+					if (!compare_constants(i.op, lhs.value, rhs.value)) {
+						return;
+					}
+					this->emit(Opcode::jmp);
+				} else {
+					this->compare(this->comparison(i.op, Opcode::jlt_rr, Opcode::jle_rr, Opcode::jeq_rr), this->comparison(i.op, Opcode::jlt_ri, Opcode::jle_ri, Opcode::jeq_ri), this->comparison(i.op, Opcode::jgt_ri, Opcode::jge_ri, Opcode::jeq_ri), lhs, rhs);
+				}
+				this->reference(i.label.symbol, ReferenceKind::target);
+			});
+		}
+
+		virtual void visit(Instruction_label &i) override {
+			this->define(i.label.symbol);
+		}
+
+		virtual void visit(Instruction_goto &i) override {
+			this->emit(Opcode::jmp);
+			this->reference(i.label.symbol, ReferenceKind::target);
+		}
+
+		virtual void visit(Instruction_call &i) override {
+			// the caller already stored the return address at "mem rsp -8"
+			int64_t size = 8 * (stack_arguments(i.num_arguments) + 1);
+			i.with_operands([this, size](auto callee) { this->call(size, callee); });
+		}
+
+		virtual void visit(Instruction_call_runtime &i) override {
+			switch (i.function) {
+				case RuntimeFunction::print: this->emit(Opcode::print); break;
+				case RuntimeFunction::input: this->emit(Opcode::input); break;
+				case RuntimeFunction::allocate: this->emit(Opcode::allocate); break;
+				case RuntimeFunction::tuple_error: this->emit(Opcode::tuple_error); break;
+				case RuntimeFunction::tensor_error:
+					if (i.num_arguments == 1) {
+						this->emit(Opcode::tensor_error_null);
+					} else if (i.num_arguments == 3) {
+						this->emit(Opcode::tensor_error);
+					} else {
+						this->emit(Opcode::tensor_error_dimension);
+					}
+					break;
+			}
+		}
+
+		virtual void visit(Instruction_increment &i) override {
+			this->emit(Opcode::inc, index(i.destination.reg));
+		}
+
+		virtual void visit(Instruction_decrement &i) override {
+			this->emit(Opcode::dec, index(i.destination.reg));
+		}
+
+		virtual void visit(Instruction_lea &i) override {
+			this->emit(Opcode::lea, index(i.destination.reg), index(i.base.reg), index(i.index.reg), i.scale);
+		}
+
+		private:
+
+		std::vector<Bytecode> &code;
+		std::vector<int64_t> &symbol_indices;
+		std::vector<LabelReference> &label_references;
+		const SymbolTable &symbols;
+		int64_t frame_size;
+
+		/*
+		 * One overload per form of each instruction; with_operands picks the
+		 * overload at compile time from the shapes of the operands.
+		 */
+
+		void assign(shape::w d, shape::x s) { this->emit(Opcode::mov_rr, index(d), index(s)); }
+		void assign(shape::w d, shape::Number s) { this->emit(Opcode::mov_ri, index(d)).value = s.value; }
+		void assign(shape::w d, shape::Memory s) { this->emit(Opcode::load, index(d), index(s.base), 0, s.offset); }
+		void assign(shape::w d, shape::Label s) {
+			this->emit(Opcode::mov_ri, index(d));
+			this->reference(s.symbol, ReferenceKind::value);
+		}
+		void assign(shape::Memory d, shape::x s) { this->emit(Opcode::store_r, index(d.base), index(s), 0, d.offset); }
+		void assign(shape::Memory d, shape::Number s) { this->emit(Opcode::store_i, index(d.base), 0, 0, d.offset).value = s.value; }
+		void assign(shape::Memory d, shape::Label s) {
+			this->emit(Opcode::store_i, index(d.base), 0, 0, d.offset);
+			this->reference(s.symbol, ReferenceKind::value);
+		}
+
+		void arithmetic(Operator op, shape::w d, shape::x s) {
+			this->emit(this->arithmetic(op, Opcode::add_rr, Opcode::sub_rr, Opcode::mul_rr, Opcode::and_rr), index(d), index(s));
+		}
+		void arithmetic(Operator op, shape::w d, shape::Number s) {
+			this->emit(this->arithmetic(op, Opcode::add_ri, Opcode::sub_ri, Opcode::mul_ri, Opcode::and_ri), index(d), 0, 0, s.value);
+		}
+		void arithmetic(Operator op, shape::w d, shape::Memory s) {
+			this->emit(op == Operator::minus ? Opcode::sub_rm : Opcode::add_rm, index(d), index(s.base), 0, s.offset);
+		}
+		void arithmetic(Operator op, shape::Memory d, shape::x s) {
+			this->emit(op == Operator::minus ? Opcode::sub_mr : Opcode::add_mr, index(d.base), index(s), 0, d.offset);
+		}
+		void arithmetic(Operator op, shape::Memory d, shape::Number s) {
+			this->emit(op == Operator::minus ? Opcode::sub_mi : Opcode::add_mi, index(d.base), 0, 0, d.offset).value = s.value;
+		}
+
+		void shift(bool left, shape::w d, shape::sx s) { this->emit(left ? Opcode::shl_rr : Opcode::sar_rr, index(d), index(s)); }
+		void shift(bool left, shape::w d, shape::Number s) {
+			// like x86, only the low 6 bits of the count matter
+			this->emit(left ? Opcode::shl_ri : Opcode::sar_ri, index(d), 0, 0, s.value & 63);
+		}
+
+		/*
+		 * "d <- lhs cmp rhs" (compare_assignment) and "cjump lhs cmp rhs"
+		 * (cjump, without d) with the opcodes for the register-register,
+		 * register-constant and constant-register ("N < r" is "r > N") forms.
+		 */
+		void compare(Opcode rr, Opcode ri, Opcode ir, uint8_t d, shape::x lhs, shape::x rhs) { this->emit(rr, d, index(lhs), index(rhs)); }
+		void compare(Opcode rr, Opcode ri, Opcode ir, uint8_t d, shape::x lhs, shape::Number rhs) { this->emit(ri, d, index(lhs), 0, rhs.value); }
+		void compare(Opcode rr, Opcode ri, Opcode ir, uint8_t d, shape::Number lhs, shape::x rhs) { this->emit(ir, d, index(rhs), 0, lhs.value); }
+		void compare(Opcode rr, Opcode ri, Opcode ir, shape::x lhs, shape::x rhs) { this->emit(rr, index(lhs), index(rhs)); }
+		void compare(Opcode rr, Opcode ri, Opcode ir, shape::x lhs, shape::Number rhs) { this->emit(ri, index(lhs), 0, 0, rhs.value); }
+		void compare(Opcode rr, Opcode ri, Opcode ir, shape::Number lhs, shape::x rhs) { this->emit(ir, index(rhs), 0, 0, lhs.value); }
+
+		void call(int64_t size, shape::w callee) { this->emit(Opcode::call_r, index(callee), 0, 0, size); }
+		void call(int64_t size, shape::Label callee) {
+			this->emit(Opcode::call, 0, 0, 0, size);
+			this->reference(callee.symbol, ReferenceKind::target);
+		}
+
+		Bytecode &emit(Opcode opcode, uint8_t a = 0, uint8_t b = 0, uint8_t c = 0, int64_t imm = 0) {
+			Bytecode instruction;
+			instruction.handler = nullptr;
+			instruction.opcode = opcode;
+			instruction.a = a;
+			instruction.b = b;
+			instruction.c = c;
+			instruction.imm = imm;
+			instruction.value = 0;
+			this->code.push_back(instruction);
+			return this->code.back();
+		}
+
+		// the last instruction emitted refers to `symbol`
+		void reference(SymbolID symbol, ReferenceKind kind) {
+			this->label_references.push_back({this->code.size() - 1, symbol, kind});
+		}
+
+		void define(SymbolID symbol) {
+			if (symbol >= this->symbol_indices.size()) {
+				this->symbol_indices.resize(this->symbols.size(), -1);
+			}
+			if (this->symbol_indices[symbol] >= 0) {
+				throw std::runtime_error("_" + this->symbols.name(symbol) + " is defined more than once");
+			}
+			this->symbol_indices[symbol] = this->code.size();
+		}
+
+		static Opcode arithmetic(Operator op, Opcode plus, Opcode minus, Opcode times, Opcode bitwise_and) {
+			switch (op) {
+				case Operator::plus: return plus;
+				case Operator::minus: return minus;
+				case Operator::times: return times;
+				default: return bitwise_and;
+			}
+		}
+
+		static Opcode comparison(Operator op, Opcode lt, Opcode le, Opcode eq) {
+			switch (op) {
+				case Operator::lt: return lt;
+				case Operator::le: return le;
+				default: return eq;
+			}
+		}
+	};
+
+	/*
+	 * Superinstructions: a fused opcode replaces the opcode of the first
+	 * instruction of a pair and runs both, the second with the operands of
+	 * the instruction after it. That instruction is left as it is, so jumps
+	 * to it still work and it can itself start another pair.
+	 *
+	 * The pairs are the most frequent adjacent ones reported by
+	 * "L1i --profile-pairs".
+	 */
+	struct FusedPair {
+		Opcode first;
+		Opcode second;
+		Opcode fused;
+	};
+
+	static const FusedPair fused_pairs[] = {
+		{Opcode::store_i, Opcode::call, Opcode::store_i_then_call},
+		{Opcode::mov_rr, Opcode::print, Opcode::mov_rr_then_print},
+		{Opcode::load, Opcode::print, Opcode::load_then_print},
+		{Opcode::load, Opcode::add_rr, Opcode::load_then_add_rr},
+		{Opcode::load, Opcode::load, Opcode::load_then_load},
+		{Opcode::lt_rr, Opcode::jeq_ri, Opcode::lt_rr_then_jeq_ri},
+		{Opcode::lt_ri, Opcode::jeq_ri, Opcode::lt_ri_then_jeq_ri},
+		{Opcode::le_rr, Opcode::jeq_ri, Opcode::le_rr_then_jeq_ri},
+		{Opcode::le_ri, Opcode::jeq_ri, Opcode::le_ri_then_jeq_ri},
+		{Opcode::eq_rr, Opcode::jeq_ri, Opcode::eq_rr_then_jeq_ri},
+		{Opcode::eq_ri, Opcode::jeq_ri, Opcode::eq_ri_then_jeq_ri},
+		{Opcode::inc, Opcode::jlt_ri, Opcode::inc_then_jlt_ri},
+		{Opcode::and_ri, Opcode::jeq_ri, Opcode::and_ri_then_jeq_ri}
+	};
+
+	static const char *const opcode_names[] = {
+		"halt",
+		"mov_rr", "mov_ri", "load", "store_r", "store_i",
+		"add_rr", "add_ri", "add_rm", "add_mr", "add_mi",
+		"sub_rr", "sub_ri", "sub_rm", "sub_mr", "sub_mi",
+		"mul_rr", "mul_ri",
+		"and_rr", "and_ri",
+		"shl_rr", "shl_ri", "sar_rr", "sar_ri",
+		"lt_rr", "lt_ri", "le_rr", "le_ri", "eq_rr", "eq_ri", "gt_ri", "ge_ri",
+		"jlt_rr", "jlt_ri", "jle_rr", "jle_ri", "jeq_rr", "jeq_ri", "jgt_ri", "jge_ri",
+		"jmp",
+		"call", "call_r", "ret",
+		"inc", "dec", "lea",
+		"print", "input", "allocate", "tuple_error", "tensor_error_null", "tensor_error", "tensor_error_dimension",
+		"store_i_then_call",
+		"mov_rr_then_print", "load_then_print",
+		"load_then_add_rr", "load_then_load",
+		"lt_rr_then_jeq_ri", "lt_ri_then_jeq_ri", "le_rr_then_jeq_ri", "le_ri_then_jeq_ri", "eq_rr_then_jeq_ri", "eq_ri_then_jeq_ri",
+		"inc_then_jlt_ri", "and_ri_then_jeq_ri"
+	};
+	static_assert(sizeof(opcode_names) / sizeof(opcode_names[0]) == static_cast<std::size_t>(Opcode::count), "every opcode needs a name");
+
+	static const std::size_t num_opcodes = static_cast<std::size_t>(Opcode::count);
+
+	// BytecodeProgram methods
+
+	BytecodeProgram::BytecodeProgram(const Program &p, bool fuse) : threaded {false} {
+		std::vector<int64_t> symbol_indices;
+		std::vector<BytecodeSelector::LabelReference> label_references;
+		BytecodeSelector selector(this->code, symbol_indices, label_references, p.symbols);
+
+		selector.begin(p.entryPointLabel);
+		for (const Function *f : p.functions) {
+			selector.add_function(*f);
+		}
+
+		// the code doesn't move from here on, so pointers into it are final
+		symbol_indices.resize(p.symbols.size(), -1);
+		for (const auto &r : label_references) {
+			int64_t target = symbol_indices[r.symbol];
+			if (target < 0) {
+				throw std::runtime_error("_" + p.symbols.name(r.symbol) + " is never defined");
+			}
+			if (r.kind == BytecodeSelector::ReferenceKind::target) {
+				this->code[r.index].target = this->code.data() + target;
+			} else {
+				this->code[r.index].value = reinterpret_cast<int64_t>(this->code.data() + target);
+			}
+		}
+		this->code[0].value = reinterpret_cast<int64_t>(&this->code[2]);
+
+		if (fuse) {
+			for (std::size_t i = 0; i + 1 < this->code.size(); i++) {
+				for (const FusedPair &pair : fused_pairs) {
+					if (this->code[i].opcode == pair.first && this->code[i + 1].opcode == pair.second) {
+						this->code[i].opcode = pair.fused;
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	void BytecodeProgram::run() {
+		this->execute<false>(nullptr);
+	}
+
+	void BytecodeProgram::profile_pairs(std::ostream &out) {
+		std::vector<uint64_t> pair_counts(num_opcodes * num_opcodes, 0);
+		this->execute<true>(&pair_counts);
+
+		std::vector<std::size_t> pairs;
+		for (std::size_t pair = 0; pair < pair_counts.size(); pair++) {
+			if (pair_counts[pair] > 0) {
+				pairs.push_back(pair);
+			}
+		}
+		std::sort(pairs.begin(), pairs.end(), [&pair_counts](std::size_t a, std::size_t b) {
+			return pair_counts[a] > pair_counts[b];
+		});
+		for (std::size_t pair : pairs) {
+			out << pair_counts[pair] << " " << opcode_names[pair / num_opcodes] << " " << opcode_names[pair % num_opcodes] << "\n";
+		}
+	}
+
+	// wrapping arithmetic, as in the machine
+	static int64_t add(int64_t a, int64_t b) {
+		return static_cast<int64_t>(static_cast<uint64_t>(a) + static_cast<uint64_t>(b));
+	}
+
+	static int64_t subtract(int64_t a, int64_t b) {
+		return static_cast<int64_t>(static_cast<uint64_t>(a) - static_cast<uint64_t>(b));
+	}
+
+	static int64_t multiply(int64_t a, int64_t b) {
+		return static_cast<int64_t>(static_cast<uint64_t>(a) * static_cast<uint64_t>(b));
+	}
+
+	static int64_t shift_left(int64_t a, int64_t count) {
+		return static_cast<int64_t>(static_cast<uint64_t>(a) << (count & 63));
+	}
+
+	static int64_t shift_right(int64_t a, int64_t count) {
+		return a >> (count & 63);
+	}
+
+/*
+ * The dispatch uses the GNU "labels as values" extension: every instruction
+ * holds the address of its handler and each handler jumps straight to the
+ * next one, with no central loop or switch.
+ *
+ * When profiling, the handlers are looked up by opcode instead (the code is
+ * threaded for the other instantiation) and every pair of adjacent
+ * instructions that run one after the other is counted.
+ */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+	template <bool profile>
+	void BytecodeProgram::execute(std::vector<uint64_t> *pair_counts) {
+		static const void *const handlers[] = {
+			&&op_halt,
+			&&op_mov_rr, &&op_mov_ri, &&op_load, &&op_store_r, &&op_store_i,
+			&&op_add_rr, &&op_add_ri, &&op_add_rm, &&op_add_mr, &&op_add_mi,
+			&&op_sub_rr, &&op_sub_ri, &&op_sub_rm, &&op_sub_mr, &&op_sub_mi,
+			&&op_mul_rr, &&op_mul_ri,
+			&&op_and_rr, &&op_and_ri,
+			&&op_shl_rr, &&op_shl_ri, &&op_sar_rr, &&op_sar_ri,
+			&&op_lt_rr, &&op_lt_ri, &&op_le_rr, &&op_le_ri, &&op_eq_rr, &&op_eq_ri, &&op_gt_ri, &&op_ge_ri,
+			&&op_jlt_rr, &&op_jlt_ri, &&op_jle_rr, &&op_jle_ri, &&op_jeq_rr, &&op_jeq_ri, &&op_jgt_ri, &&op_jge_ri,
+			&&op_jmp,
+			&&op_call, &&op_call_r, &&op_ret,
+			&&op_inc, &&op_dec, &&op_lea,
+			&&op_print, &&op_input, &&op_allocate, &&op_tuple_error, &&op_tensor_error_null, &&op_tensor_error, &&op_tensor_error_dimension,
+			&&op_store_i_then_call,
+			&&op_mov_rr_then_print, &&op_load_then_print,
+			&&op_load_then_add_rr, &&op_load_then_load,
+			&&op_lt_rr_then_jeq_ri, &&op_lt_ri_then_jeq_ri, &&op_le_rr_then_jeq_ri, &&op_le_ri_then_jeq_ri, &&op_eq_rr_then_jeq_ri, &&op_eq_ri_then_jeq_ri,
+			&&op_inc_then_jlt_ri, &&op_and_ri_then_jeq_ri
+		};
+		static_assert(sizeof(handlers) / sizeof(handlers[0]) == num_opcodes, "every opcode needs a handler");
+
+		if (!profile && !this->threaded) {
+			for (Bytecode &i : this->code) {
+				i.handler = handlers[static_cast<std::size_t>(i.opcode)];
+			}
+			this->threaded = true;
+		}
+
+		// the top of the stack is 16-byte aligned, as it is for "go"
+		std::unique_ptr<int64_t[]> stack(new int64_t[stack_size]);
+		int64_t regs[16] = {};
+		int64_t &rax = regs[index(RegisterID::rax)];
+		int64_t &rdi = regs[index(RegisterID::rdi)];
+		int64_t &rsi = regs[index(RegisterID::rsi)];
+		int64_t &rdx = regs[index(RegisterID::rdx)];
+		int64_t &rcx = regs[index(RegisterID::rcx)];
+		int64_t &rsp = regs[index(RegisterID::rsp)];
+		rsp = reinterpret_cast<int64_t>(stack.get() + stack_size);
+
+		const Bytecode *pc = this->code.data();
+		const Bytecode *previous = nullptr;
+
+#define MEMORY(base, offset) (*reinterpret_cast<int64_t *>(add(regs[base], (offset))))
+#define DISPATCH() do { \
+	if (profile) { \
+		if (pc == previous + 1) { \
+			(*pair_counts)[static_cast<std::size_t>(previous->opcode) * num_opcodes + static_cast<std::size_t>(pc->opcode)]++; \
+		} \
+		previous = pc; \
+		goto *handlers[static_cast<std::size_t>(pc->opcode)]; \
+	} \
+	goto *pc->handler; \
+} while (0)
+#define NEXT() do { pc++; DISPATCH(); } while (0)
+#define JUMP_IF(condition) do { pc = (condition) ? pc->target : pc + 1; DISPATCH(); } while (0)
+
+/*
+ * The body of every instruction that doesn't jump, without the dispatch,
+ * so superinstructions can reuse them.
+ */
+#define MOV_RR regs[pc->a] = regs[pc->b]
+#define LOAD regs[pc->a] = MEMORY(pc->b, pc->imm)
+#define STORE_I MEMORY(pc->a, pc->imm) = pc->value
+#define ADD_RR regs[pc->a] = add(regs[pc->a], regs[pc->b])
+#define AND_RI regs[pc->a] &= pc->imm
+#define LT_RR regs[pc->a] = regs[pc->b] < regs[pc->c]
+#define LT_RI regs[pc->a] = regs[pc->b] < pc->imm
+#define LE_RR regs[pc->a] = regs[pc->b] <= regs[pc->c]
+#define LE_RI regs[pc->a] = regs[pc->b] <= pc->imm
+#define EQ_RR regs[pc->a] = regs[pc->b] == regs[pc->c]
+#define EQ_RI regs[pc->a] = regs[pc->b] == pc->imm
+#define INC regs[pc->a] = add(regs[pc->a], 1)
+#define PRINT rax = runtime_print(rdi)
+#define CALL do { rsp = subtract(rsp, pc->imm); pc = pc->target; DISPATCH(); } while (0)
+#define JEQ_RI JUMP_IF(regs[pc->a] == pc->imm)
+#define JLT_RI JUMP_IF(regs[pc->a] < pc->imm)
+
+		DISPATCH();
+
+		op_halt: return;
+
+		op_mov_rr: MOV_RR; NEXT();
+		op_mov_ri: regs[pc->a] = pc->value; NEXT();
+		op_load: LOAD; NEXT();
+		op_store_r: MEMORY(pc->a, pc->imm) = regs[pc->b]; NEXT();
+		op_store_i: STORE_I; NEXT();
+
+		op_add_rr: ADD_RR; NEXT();
+		op_add_ri: regs[pc->a] = add(regs[pc->a], pc->imm); NEXT();
+		op_add_rm: regs[pc->a] = add(regs[pc->a], MEMORY(pc->b, pc->imm)); NEXT();
+		op_add_mr: MEMORY(pc->a, pc->imm) = add(MEMORY(pc->a, pc->imm), regs[pc->b]); NEXT();
+		op_add_mi: MEMORY(pc->a, pc->imm) = add(MEMORY(pc->a, pc->imm), pc->value); NEXT();
+		op_sub_rr: regs[pc->a] = subtract(regs[pc->a], regs[pc->b]); NEXT();
+		op_sub_ri: regs[pc->a] = subtract(regs[pc->a], pc->imm); NEXT();
+		op_sub_rm: regs[pc->a] = subtract(regs[pc->a], MEMORY(pc->b, pc->imm)); NEXT();
+		op_sub_mr: MEMORY(pc->a, pc->imm) = subtract(MEMORY(pc->a, pc->imm), regs[pc->b]); NEXT();
+		op_sub_mi: MEMORY(pc->a, pc->imm) = subtract(MEMORY(pc->a, pc->imm), pc->value); NEXT();
+		op_mul_rr: regs[pc->a] = multiply(regs[pc->a], regs[pc->b]); NEXT();
+		op_mul_ri: regs[pc->a] = multiply(regs[pc->a], pc->imm); NEXT();
+		op_and_rr: regs[pc->a] &= regs[pc->b]; NEXT();
+		op_and_ri: AND_RI; NEXT();
+
+		op_shl_rr: regs[pc->a] = shift_left(regs[pc->a], regs[pc->b]); NEXT();
+		op_shl_ri: regs[pc->a] = shift_left(regs[pc->a], pc->imm); NEXT();
+		op_sar_rr: regs[pc->a] = shift_right(regs[pc->a], regs[pc->b]); NEXT();
+		op_sar_ri: regs[pc->a] = shift_right(regs[pc->a], pc->imm); NEXT();
+
+		op_lt_rr: LT_RR; NEXT();
+		op_lt_ri: LT_RI; NEXT();
+		op_le_rr: LE_RR; NEXT();
+		op_le_ri: LE_RI; NEXT();
+		op_eq_rr: EQ_RR; NEXT();
+		op_eq_ri: EQ_RI; NEXT();
+		op_gt_ri: regs[pc->a] = regs[pc->b] > pc->imm; NEXT();
+		op_ge_ri: regs[pc->a] = regs[pc->b] >= pc->imm; NEXT();
+
+		op_jlt_rr: JUMP_IF(regs[pc->a] < regs[pc->b]);
+		op_jlt_ri: JLT_RI;
+		op_jle_rr: JUMP_IF(regs[pc->a] <= regs[pc->b]);
+		op_jle_ri: JUMP_IF(regs[pc->a] <= pc->imm);
+		op_jeq_rr: JUMP_IF(regs[pc->a] == regs[pc->b]);
+		op_jeq_ri: JEQ_RI;
+		op_jgt_ri: JUMP_IF(regs[pc->a] > pc->imm);
+		op_jge_ri: JUMP_IF(regs[pc->a] >= pc->imm);
+		op_jmp: pc = pc->target; DISPATCH();
+
+		op_call: CALL;
+		op_call_r: rsp = subtract(rsp, pc->imm); pc = reinterpret_cast<const Bytecode *>(regs[pc->a]); DISPATCH();
+		op_ret:
+			rsp = add(rsp, pc->imm);
+			pc = *reinterpret_cast<const Bytecode **>(rsp);
+			rsp = add(rsp, 8);
+			DISPATCH();
+
+		op_inc: INC; NEXT();
+		op_dec: regs[pc->a] = subtract(regs[pc->a], 1); NEXT();
+		op_lea: regs[pc->a] = add(regs[pc->b], multiply(regs[pc->c], pc->imm)); NEXT();
+
+		op_print: PRINT; NEXT();
+		op_input: rax = runtime_input(); NEXT();
+		op_allocate: rax = runtime_allocate(rdi, rsi); NEXT();
+		op_tuple_error: runtime_tuple_error(rdi, rsi, rdx); NEXT();
+		op_tensor_error_null: runtime_tensor_error_null(rdi); NEXT();
+		op_tensor_error: runtime_tensor_error(rdi, rsi, rdx); NEXT();
+		op_tensor_error_dimension: runtime_tensor_error_dimension(rdi, rsi, rdx, rcx); NEXT();
+
+		op_store_i_then_call: STORE_I; pc++; CALL;
+		op_mov_rr_then_print: MOV_RR; pc++; PRINT; NEXT();
+		op_load_then_print: LOAD; pc++; PRINT; NEXT();
+		op_load_then_add_rr: LOAD; pc++; ADD_RR; NEXT();
+		op_load_then_load: LOAD; pc++; LOAD; NEXT();
+		op_lt_rr_then_jeq_ri: LT_RR; pc++; JEQ_RI;
+		op_lt_ri_then_jeq_ri: LT_RI; pc++; JEQ_RI;
+		op_le_rr_then_jeq_ri: LE_RR; pc++; JEQ_RI;
+		op_le_ri_then_jeq_ri: LE_RI; pc++; JEQ_RI;
+		op_eq_rr_then_jeq_ri: EQ_RR; pc++; JEQ_RI;
+		op_eq_ri_then_jeq_ri: EQ_RI; pc++; JEQ_RI;
+		op_inc_then_jlt_ri: INC; pc++; JLT_RI;
+		op_and_ri_then_jeq_ri: AND_RI; pc++; JEQ_RI;
+
+#undef MEMORY
+#undef DISPATCH
+#undef NEXT
+#undef JUMP_IF
+#undef MOV_RR
+#undef LOAD
+#undef STORE_I
+#undef ADD_RR
+#undef AND_RI
+#undef LT_RR
+#undef LT_RI
+#undef LE_RR
+#undef LE_RI
+#undef EQ_RR
+#undef EQ_RI
+#undef INC
+#undef PRINT
+#undef CALL
+#undef JEQ_RI
+#undef JLT_RI
+	}
+#pragma GCC diagnostic pop
+}
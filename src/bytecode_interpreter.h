@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include <L1.h>
+
+namespace L1 {
+	/*
+	 * A program lowered to bytecode and run by a direct-threaded interpreter;
+	 * the portable alternative to JitProgram.
+	 *
+	 * Every bytecode instruction has the same width. Registers are indices
+	 * into an int64_t array indexed by RegisterID, and every label or
+	 * function operand is a pointer to the instruction it names. That
+	 * pointer is also the value of ":label" and "@function", so return
+	 * addresses stored in memory work as they do in native code.
+	 */
+	class BytecodeProgram {
+		public:
+
+		// with `fuse`, frequent pairs of instructions become superinstructions
+		BytecodeProgram(const Program &p, bool fuse = true);
+		BytecodeProgram(const BytecodeProgram &) = delete;
+		BytecodeProgram &operator=(const BytecodeProgram &) = delete;
+
+		// calls the entry point
+		void run();
+
+		/*
+		 * Runs the program and then writes how often each pair of adjacent
+		 * opcodes ran one after the other, most frequent first.
+		 */
+		void profile_pairs(std::ostream &out);
+
+		/*
+		 * The suffixes name the operands: r a register, i an immediate, m a
+		 * memory operand "mem b imm" (or "mem a imm" as a destination).
+		 */
+		enum struct Opcode : uint8_t {
+			halt,
+			mov_rr, mov_ri, load, store_r, store_i,
+			add_rr, add_ri, add_rm, add_mr, add_mi,
+			sub_rr, sub_ri, sub_rm, sub_mr, sub_mi,
+			mul_rr, mul_ri,
+			and_rr, and_ri,
+			shl_rr, shl_ri, sar_rr, sar_ri,
+			lt_rr, lt_ri, le_rr, le_ri, eq_rr, eq_ri, gt_ri, ge_ri,
+			jlt_rr, jlt_ri, jle_rr, jle_ri, jeq_rr, jeq_ri, jgt_ri, jge_ri,
+			jmp,
+			call, call_r, ret,
+			inc, dec, lea,
+			print, input, allocate, tuple_error, tensor_error_null, tensor_error, tensor_error_dimension,
+			// superinstructions, one for each pair in fused_pairs
+			store_i_then_call,
+			mov_rr_then_print, load_then_print,
+			load_then_add_rr, load_then_load,
+			lt_rr_then_jeq_ri, lt_ri_then_jeq_ri, le_rr_then_jeq_ri, le_ri_then_jeq_ri, eq_rr_then_jeq_ri, eq_ri_then_jeq_ri,
+			inc_then_jlt_ri, and_ri_then_jeq_ri,
+			count // not an opcode
+		};
+
+		struct Bytecode {
+			const void *handler; // the code for `opcode`, set by run
+			Opcode opcode;
+			uint8_t a;
+			uint8_t b;
+			uint8_t c;
+			int64_t imm;
+			union {
+				Bytecode *target; // jumps and calls
+				int64_t value; // stored or assigned constants
+			};
+		};
+
+		private:
+
+		std::vector<Bytecode> code;
+		bool threaded;
+
+		template <bool profile>
+		void execute(std::vector<uint64_t> *pair_counts);
+	};
+}
@@ -0,0 +1,245 @@
+#include <algorithm>
+#include <utility>
+
+#include <cfg.h>
+
+namespace L1 {
+	// ControlFlowGraph methods
+
+	ControlFlowGraph::ControlFlowGraph(const Function &f) {
+		const std::vector<Instruction *> &instructions = f.instructions;
+		this->block_of.resize(instructions.size());
+
+		// split at the leaders, remembering how the last instruction of each block leaves it
+		std::vector<const Operand *> targets;
+		bool leader = true;
+		for (std::size_t k = 0; k < instructions.size(); k++) {
+			ControlFlowVisitor v;
+			instructions[k]->accept(v);
+			if (v.label) {
+				leader = true;
+				this->label_blocks[v.label->symbol] = this->blocks.size();
+			}
+			if (leader) {
+				this->blocks.push_back({k, k, {}, {}, true, false});
+				targets.push_back(nullptr);
+			}
+			this->blocks.back().end = k + 1;
+			this->block_of[k] = this->blocks.size() - 1;
+			targets.back() = v.target;
+			this->blocks.back().falls_through = v.falls_through;
+			leader = v.ends_block;
+		}
+
+		// connect them
+		for (std::size_t b = 0; b < this->blocks.size(); b++) {
+			BasicBlock &block = this->blocks[b];
+			if (targets[b]) {
+				auto found = this->label_blocks.find(targets[b]->symbol);
+				if (found != this->label_blocks.end()) {
+					block.successors.push_back(found->second);
+				} else {
+					block.leaves_function = true;
+				}
+			}
+			if (block.falls_through) {
+				if (b + 1 < this->blocks.size()) {
+					// a cjump to the next block has a single successor
+					if (block.successors.empty() || block.successors[0] != b + 1) {
+						block.successors.push_back(b + 1);
+					}
+				} else {
+					block.leaves_function = true;
+				}
+			}
+			for (std::size_t s : block.successors) {
+				this->blocks[s].predecessors.push_back(b);
+			}
+		}
+	}
+
+	std::vector<std::size_t> ControlFlowGraph::reverse_postorder() const {
+		std::vector<std::size_t> order;
+		order.reserve(this->blocks.size());
+		if (this->blocks.empty()) {
+			return order;
+		}
+
+		// depth-first from the entry; each entry of the stack is a block and its next successor to visit
+		std::vector<bool> visited(this->blocks.size(), false);
+		std::vector<std::pair<std::size_t, std::size_t>> stack = {{0, 0}};
+		visited[0] = true;
+		while (!stack.empty()) {
+			auto &[b, next] = stack.back();
+			const std::vector<std::size_t> &successors = this->blocks[b].successors;
+			if (next < successors.size()) {
+				std::size_t s = successors[next++];
+				if (!visited[s]) {
+					visited[s] = true;
+					stack.push_back({s, 0});
+				}
+			} else {
+				order.push_back(b);
+				stack.pop_back();
+			}
+		}
+		std::reverse(order.begin(), order.end());
+
+		for (std::size_t b = 0; b < this->blocks.size(); b++) {
+			if (!visited[b]) {
+				order.push_back(b);
+			}
+		}
+		return order;
+	}
+
+	// Dominators methods
+
+	Dominators::Dominators(const ControlFlowGraph &cfg) :
+		immediate(cfg.blocks.size(), none),
+		entered(cfg.blocks.size(), 0),
+		left(cfg.blocks.size(), 0)
+	{
+		std::size_t num_blocks = cfg.blocks.size();
+		if (num_blocks == 0) {
+			return;
+		}
+
+		/*
+		 * Cooper, Harvey and Kennedy's "A Simple, Fast Dominance Algorithm":
+		 * in reverse postorder, intersect the dominators of the predecessors
+		 * found so far, until nothing changes.
+		 */
+		std::vector<std::size_t> order = cfg.reverse_postorder();
+		std::vector<std::size_t> position(num_blocks);
+		for (std::size_t p = 0; p < num_blocks; p++) {
+			position[order[p]] = p;
+		}
+		auto intersect = [&](std::size_t a, std::size_t b) {
+			while (a != b) {
+				while (position[a] > position[b]) {
+					a = this->immediate[a];
+				}
+				while (position[b] > position[a]) {
+					b = this->immediate[b];
+				}
+			}
+			return a;
+		};
+		this->immediate[0] = 0;
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			for (std::size_t b : order) {
+				if (b == 0) {
+					continue;
+				}
+				std::size_t dominator = none;
+				for (std::size_t p : cfg.blocks[b].predecessors) {
+					if (this->immediate[p] == none) {
+						continue;
+					}
+					dominator = dominator == none ? p : intersect(p, dominator);
+				}
+				if (dominator != this->immediate[b]) {
+					this->immediate[b] = dominator;
+					changed = true;
+				}
+			}
+		}
+
+		// number the tree
+		std::vector<std::vector<std::size_t>> children(num_blocks);
+		for (std::size_t b = 1; b < num_blocks; b++) {
+			if (this->immediate[b] != none) {
+				children[this->immediate[b]].push_back(b);
+			}
+		}
+		std::size_t clock = 0;
+		std::vector<std::pair<std::size_t, std::size_t>> stack = {{0, 0}};
+		this->entered[0] = clock++;
+		while (!stack.empty()) {
+			auto &[b, next] = stack.back();
+			if (next < children[b].size()) {
+				std::size_t child = children[b][next++];
+				this->entered[child] = clock++;
+				stack.push_back({child, 0});
+			} else {
+				this->left[b] = clock++;
+				stack.pop_back();
+			}
+		}
+	}
+
+	bool Dominators::dominates(std::size_t a, std::size_t b) const {
+		if (this->immediate[a] == none || this->immediate[b] == none) {
+			return false;
+		}
+		return this->entered[a] <= this->entered[b] && this->left[b] <= this->left[a];
+	}
+
+	// LoopNest methods
+
+	LoopNest::LoopNest(const ControlFlowGraph &cfg, const Dominators &dominators) :
+		depth(cfg.blocks.size(), 0),
+		innermost(cfg.blocks.size(), none)
+	{
+		std::size_t num_blocks = cfg.blocks.size();
+
+		// one loop per header with back edges
+		std::unordered_map<std::size_t, std::size_t> loop_of_header;
+		for (std::size_t b = 0; b < num_blocks; b++) {
+			for (std::size_t s : cfg.blocks[b].successors) {
+				if (!dominators.dominates(s, b)) {
+					continue;
+				}
+				auto [found, added] = loop_of_header.insert({s, this->loops.size()});
+				if (added) {
+					this->loops.push_back({s, {}, {}, none});
+				}
+				this->loops[found->second].latches.push_back(b);
+			}
+		}
+
+		// the body: everything that reaches a latch backwards without passing the header
+		std::vector<std::size_t> in_loop(num_blocks, none);
+		for (std::size_t l = 0; l < this->loops.size(); l++) {
+			Loop &loop = this->loops[l];
+			in_loop[loop.header] = l;
+			loop.blocks.push_back(loop.header);
+			std::vector<std::size_t> stack;
+			for (std::size_t latch : loop.latches) {
+				if (in_loop[latch] != l) {
+					in_loop[latch] = l;
+					loop.blocks.push_back(latch);
+					stack.push_back(latch);
+				}
+			}
+			while (!stack.empty()) {
+				std::size_t b = stack.back();
+				stack.pop_back();
+				for (std::size_t p : cfg.blocks[b].predecessors) {
+					if (in_loop[p] != l && dominators.immediate[p] != Dominators::none) {
+						in_loop[p] = l;
+						loop.blocks.push_back(p);
+						stack.push_back(p);
+					}
+				}
+			}
+			std::sort(loop.blocks.begin(), loop.blocks.end());
+		}
+
+		// bigger loops first, so every loop comes after the ones around it
+		std::sort(this->loops.begin(), this->loops.end(), [](const Loop &a, const Loop &b) {
+			return a.blocks.size() != b.blocks.size() ? a.blocks.size() > b.blocks.size() : a.header < b.header;
+		});
+		for (std::size_t l = 0; l < this->loops.size(); l++) {
+			Loop &loop = this->loops[l];
+			loop.parent = this->innermost[loop.header];
+			for (std::size_t b : loop.blocks) {
+				this->depth[b]++;
+				this->innermost[b] = l;
+			}
+		}
+	}
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <L1.h>
+
+namespace L1 {
+	// what an instruction does to the flow of control
+	struct ControlFlowVisitor : InstructionVisitor {
+		Operand *label = nullptr; // the label it defines
+		Operand *target = nullptr; // the label it may jump to
+		bool falls_through = true;
+		bool ends_block = false;
+
+		virtual void visit(Instruction_ret &i) override {
+			this->falls_through = false;
+			this->ends_block = true;
+		}
+
+		virtual void visit(Instruction_assignment &i) override {}
+		virtual void visit(Instruction_arithmetic &i) override {}
+		virtual void visit(Instruction_shift &i) override {}
+		virtual void visit(Instruction_compare_assignment &i) override {}
+
+		virtual void visit(Instruction_cjump &i) override {
+			this->target = &i.label;
+			this->ends_block = true;
+		}
+
+		virtual void visit(Instruction_label &i) override {
+			this->label = &i.label;
+		}
+
+		virtual void visit(Instruction_goto &i) override {
+			this->target = &i.label;
+			this->falls_through = false;
+			this->ends_block = true;
+		}
+
+		virtual void visit(Instruction_call &i) override {}
+
+		virtual void visit(Instruction_call_runtime &i) override {
+			// tuple-error and tensor-error never return
+			if (i.function == RuntimeFunction::tuple_error || i.function == RuntimeFunction::tensor_error) {
+				this->falls_through = false;
+				this->ends_block = true;
+			}
+		}
+
+		virtual void visit(Instruction_increment &i) override {}
+		virtual void visit(Instruction_decrement &i) override {}
+		virtual void visit(Instruction_lea &i) override {}
+	};
+
+	/*
+	 * A run of instructions that is only entered at its first instruction
+	 * and only left after its last one: f.instructions[begin, end). Blocks
+	 * refer to each other by index into ControlFlowGraph::blocks.
+	 */
+	struct BasicBlock {
+		std::size_t begin;
+		std::size_t end;
+		std::vector<std::size_t> successors;
+		std::vector<std::size_t> predecessors;
+
+		// control may go on to the instruction after the block's last one
+		bool falls_through;
+
+		/*
+		 * Control may go on outside the function's code: past its last
+		 * instruction, or to a label the function doesn't define.
+		 */
+		bool leaves_function;
+	};
+
+	/*
+	 * The basic blocks of one function, in the order of its instructions, so
+	 * block 0 is the entry. A block starts at every label and after every
+	 * goto, cjump and return, and after the runtime calls that never return
+	 * (tuple-error and tensor-error). Calls don't end blocks: a call comes
+	 * back to the instruction after it.
+	 *
+	 * The graph refers to f.instructions by index, so it has to be rebuilt
+	 * whenever instructions are added or removed.
+	 */
+	struct ControlFlowGraph {
+		std::vector<BasicBlock> blocks;
+
+		// the block each instruction is in
+		std::vector<std::size_t> block_of;
+
+		// the block that starts at each label of the function
+		std::unordered_map<SymbolID, std::size_t> label_blocks;
+
+		ControlFlowGraph(const Function &f);
+
+		/*
+		 * Every block, each one after all of its predecessors except along
+		 * loop back edges. Blocks that can't be reached from the entry come
+		 * last, in instruction order.
+		 */
+		std::vector<std::size_t> reverse_postorder() const;
+	};
+
+	/*
+	 * The dominator tree of a ControlFlowGraph: block a dominates block b
+	 * if every path from the entry to b goes through a.
+	 */
+	struct Dominators {
+		static constexpr std::size_t none = SIZE_MAX;
+
+		/*
+		 * The immediate dominator of each block. The entry is its own, and
+		 * blocks the entry can't reach have none.
+		 */
+		std::vector<std::size_t> immediate;
+
+		Dominators(const ControlFlowGraph &cfg);
+
+		// false if either block can't be reached
+		bool dominates(std::size_t a, std::size_t b) const;
+
+		private:
+
+		/*
+		 * When a depth-first walk of the tree enters and leaves each block; a
+		 * dominates b if a's interval contains b's.
+		 */
+		std::vector<std::size_t> entered;
+		std::vector<std::size_t> left;
+	};
+
+	/*
+	 * A natural loop: a header block and every block that can get to a back
+	 * edge into the header (an edge from a block the header dominates)
+	 * without going through the header. Back edges into the same header
+	 * make up one loop.
+	 */
+	struct Loop {
+		std::size_t header;
+
+		// including the header, in increasing order
+		std::vector<std::size_t> blocks;
+
+		// the blocks with a back edge into the header
+		std::vector<std::size_t> latches;
+
+		// the innermost loop around this one, or LoopNest::none
+		std::size_t parent;
+	};
+
+	/*
+	 * The natural loops of a function. Cycles that can be entered at more
+	 * than one block (which L1 code can have, but compiled code rarely
+	 * does) have no header that dominates them, so they are not loops.
+	 */
+	struct LoopNest {
+		static constexpr std::size_t none = SIZE_MAX;
+
+		// outer loops before the loops inside them
+		std::vector<Loop> loops;
+
+		// how many loops each block is in
+		std::vector<uint32_t> depth;
+
+		// the innermost loop each block is in, or none
+		std::vector<std::size_t> innermost;
+
+		LoopNest(const ControlFlowGraph &cfg, const Dominators &dominators);
+	};
+}
@@ -1,29 +1,593 @@
+#include <stdexcept>
 #include <string>
-#include <iostream>
-#include <fstream>
+#include <string_view>
 
 #include <code_generator.h>
+#include <object_generator.h>
+#include <compare_branch.h>
+#include <block_layout.h>
+#include <x86_encoder.h>
 
 using namespace std;
 
 namespace L1 {
-	void generate_code(Program p){
+	/*
+	 * Names used in the assembly.
+	 */
+	static const std::string_view register_names_64[] = {
+		"%rax", "%rbx", "%rcx", "%rdx", "%rdi", "%rsi", "%r8", "%r9",
+		"%r10", "%r11", "%r12", "%r13", "%r14", "%r15", "%rbp", "%rsp"
+	};
+
+	static const std::string_view register_names_8[] = {
+		"%al", "%bl", "%cl", "%dl", "%dil", "%sil", "%r8b", "%r9b",
+		"%r10b", "%r11b", "%r12b", "%r13b", "%r14b", "%r15b", "%bpl", "%spl"
+	};
+
+	static std::string_view register_name(RegisterID id) {
+		return register_names_64[static_cast<int>(id)];
+	}
+
+	static std::string_view register_name_8(RegisterID id) {
+		return register_names_8[static_cast<int>(id)];
+	}
+
+	// suffix of the setCC/jCC instruction that tests `lhs op rhs`
+	static std::string_view condition_code(Operator op) {
+		switch (op) {
+			case Operator::lt: return "l";
+			case Operator::le: return "le";
+			case Operator::eq: return "e";
+			default: return "?";
+		}
+	}
+
+	// suffix of the setCC/jCC instruction that tests `rhs op lhs`
+	static std::string_view swapped_condition_code(Operator op) {
+		switch (op) {
+			case Operator::lt: return "g";
+			case Operator::le: return "ge";
+			case Operator::eq: return "e";
+			default: return "?";
+		}
+	}
+
+	// suffix of the setCC/jCC instruction that tests the opposite of `cc`
+	static std::string_view negated_condition_code(std::string_view cc) {
+		if (cc == "e") return "ne";
+		if (cc == "l") return "ge";
+		if (cc == "le") return "g";
+		if (cc == "g") return "le";
+		if (cc == "ge") return "l";
+		return "?";
+	}
+
+	static std::string_view arithmetic_mnemonic(Operator op) {
+		switch (op) {
+			case Operator::plus: return "addq";
+			case Operator::minus: return "subq";
+			case Operator::times: return "imulq";
+			case Operator::bitwise_and: return "andq";
+			case Operator::lshift: return "salq";
+			case Operator::rshift: return "sarq";
+			default: return "?";
+		}
+	}
+
+	int32_t immediate(int64_t value) {
+		if (!fits_in_int32(value)) {
+			throw std::runtime_error("constant " + std::to_string(value) + " doesn't fit in 32 bits");
+		}
+		return static_cast<int32_t>(value);
+	}
+
+	uint8_t shift_count(int64_t count) {
+		if (count < -128 || count > 255) {
+			throw std::runtime_error("shift count " + std::to_string(count) + " doesn't fit in 8 bits");
+		}
+		return static_cast<uint8_t>(count);
+	}
+
+	/*
+	 * Instruction selection for the body of one function. A block that
+	 * doesn't start with an L1 label gets a local label made from the
+	 * function's name and the block's index.
+	 */
+	class InstructionSelector : public BlockSelector {
+		public:
+
+		InstructionSelector(OutputBuffer &output, const Function &f, const SymbolTable &symbols) :
+			output {output},
+			f {f},
+			symbols {symbols}
+		{}
+
+		virtual void visit(Instruction_ret &i) override {
+			int64_t frame = 8 * (this->f.num_locals + stack_arguments(this->f.num_arguments));
+			if (frame > 0) {
+				this->line("addq", "$", immediate(frame), "%rsp");
+			}
+			this->output.append("  retq\n");
+		}
+
+		virtual void visit(Instruction_assignment &i) override {
+			// only a register takes a 64-bit immediate
+			if (i.destination.kind != OperandKind::reg) {
+				this->check_immediate(i.source);
+			}
+			this->instruction("movq", i.source, i.destination);
+		}
+
+		virtual void visit(Instruction_arithmetic &i) override {
+			this->check_immediate(i.source);
+			this->instruction(arithmetic_mnemonic(i.op), i.source, i.destination);
+		}
+
+		virtual void visit(Instruction_shift &i) override {
+			// the count register is always rcx, used as %cl
+			this->output.append("  ");
+			this->output.append(arithmetic_mnemonic(i.op));
+			this->output.append(' ');
+			if (i.source.kind == OperandKind::reg) {
+				this->output.append("%cl");
+			} else {
+				this->output.append('$');
+				this->output.append_number(shift_count(i.source.value));
+			}
+			this->output.append(", ");
+			this->operand(i.destination);
+			this->output.append('\n');
+		}
+
+		virtual void visit(Instruction_compare_assignment &i) override {
+			if (i.lhs.kind == OperandKind::number && i.rhs.kind == OperandKind::number) {
+				this->line("movq", "$", compare_constants(i.op, i.lhs.value, i.rhs.value), register_name(i.destination.reg));
+				return;
+			}
+			this->set(this->compare(i.op, i.lhs, i.rhs), i.destination.reg);
+		}
+
+		virtual void visit(Instruction_cjump &i) override {
+			this->cjump(i, false, {&i.label, 0});
+		}
+
+		virtual void visit(Instruction_label &i) override {
+			this->label(i.label);
+			this->output.append(":\n");
+		}
+
+		virtual void visit(Instruction_goto &i) override {
+			this->jump("jmp", i.label);
+		}
+
+		virtual void visit(Instruction_call &i) override {
+			// the caller already stored the return address at "mem rsp -8"
+			this->line("subq", "$", immediate(8 * (stack_arguments(i.num_arguments) + 1)), "%rsp");
+			if (i.callee.kind == OperandKind::reg) {
+				this->output.append("  jmp *");
+				this->output.append(register_name(i.callee.reg));
+				this->output.append('\n');
+			} else {
+				this->jump("jmp", i.callee);
+			}
+		}
+
+		virtual void visit(Instruction_call_runtime &i) override {
+			this->output.append("  call ");
+			this->output.append(runtime_function_name(i.function));
+			this->output.append('\n');
+		}
+
+		virtual void visit(Instruction_increment &i) override {
+			this->output.append("  inc ");
+			this->output.append(register_name(i.destination.reg));
+			this->output.append('\n');
+		}
+
+		virtual void visit(Instruction_decrement &i) override {
+			this->output.append("  dec ");
+			this->output.append(register_name(i.destination.reg));
+			this->output.append('\n');
+		}
+
+		virtual void visit(Instruction_lea &i) override {
+			this->output.append("  lea (");
+			this->output.append(register_name(i.base.reg));
+			this->output.append(", ");
+			this->output.append(register_name(i.index.reg));
+			this->output.append(", ");
+			this->output.append_number(i.scale);
+			this->output.append("), ");
+			this->output.append(register_name(i.destination.reg));
+			this->output.append('\n');
+		}
+
+		/*
+		 * A cjump that goes to `target`, when its condition holds or, if
+		 * `negate`, when it doesn't.
+		 */
+		virtual void cjump(const Instruction_cjump &i, bool negate, const JumpTarget &target) override {
+			if (i.lhs.kind == OperandKind::number && i.rhs.kind == OperandKind::number) {
+				if (compare_constants(i.op, i.lhs.value, i.rhs.value) != negate) {
+					this->jump("jmp", target);
+				}
+				return;
+			}
+			std::string_view cc = this->compare(i.op, i.lhs, i.rhs);
+			this->jump_if(negate ? negated_condition_code(cc) : cc, target);
+		}
+
 		/*
-		 * Open the output file.
+		 * A compare whose result feeds the cjump after it: one cmpq and one
+		 * jCC, to `target`, negated if `negate`.
 		 */
-		std::ofstream outputFile;
-		outputFile.open("prog.S");
+		virtual void compare_branch(const CompareBranch &branch, bool negate, const JumpTarget &target) override {
+			const Instruction_compare_assignment &c = *branch.compare;
+			bool jump_if_true = branch.jump_if_true != negate;
+			if (c.lhs.kind == OperandKind::number && c.rhs.kind == OperandKind::number) {
+				bool holds = compare_constants(c.op, c.lhs.value, c.rhs.value);
+				if (branch.result_live) {
+					this->line("movq", "$", holds, register_name(c.destination.reg));
+				}
+				if (holds == jump_if_true) {
+					this->jump("jmp", target);
+				}
+				return;
+			}
+			std::string_view cc = this->compare(c.op, c.lhs, c.rhs);
+			if (branch.result_live) {
+				// neither setCC nor movzbq touch the flags
+				this->set(cc, c.destination.reg);
+			}
+			this->jump_if(jump_if_true ? cc : negated_condition_code(cc), target);
+		}
+
+		virtual void start_block(std::size_t b, bool aligned, bool needs_label) override {
+			if (aligned) {
+				this->output.append("  .p2align 4\n");
+			}
+			if (needs_label) {
+				this->target({nullptr, b});
+				this->output.append(":\n");
+			}
+		}
+
+		virtual void jump(const JumpTarget &target) override {
+			this->jump("jmp", target);
+		}
+
+		void jump(std::string_view mnemonic, const JumpTarget &target) {
+			this->output.append("  ");
+			this->output.append(mnemonic);
+			this->output.append(' ');
+			this->target(target);
+			this->output.append('\n');
+		}
+
+		// "  jCC target"
+		void jump_if(std::string_view cc, const JumpTarget &target) {
+			this->output.append("  j");
+			this->output.append(cc);
+			this->output.append(' ');
+			this->target(target);
+			this->output.append('\n');
+		}
+
+		void target(const JumpTarget &target) {
+			if (target.label) {
+				this->label(*target.label);
+				return;
+			}
+			this->output.append(".L_");
+			this->output.append(this->symbols.name(this->f.name));
+			this->output.append('.');
+			this->output.append_number(target.block);
+		}
+
+		private:
+
+		OutputBuffer &output;
+		const Function &f;
+		const SymbolTable &symbols;
+
+		// L1 labels and function names become assembly labels with a leading '_'
+		void label(const Operand &o) {
+			this->output.append('_');
+			this->output.append(this->symbols.name(o.symbol));
+		}
+
+		void operand(const Operand &o) {
+			switch (o.kind) {
+				case OperandKind::reg:
+					this->output.append(register_name(o.reg));
+					break;
+				case OperandKind::number:
+					this->output.append('$');
+					this->output.append_number(o.value);
+					break;
+				case OperandKind::label:
+				case OperandKind::function_name:
+					this->output.append('$');
+					this->label(o);
+					break;
+				case OperandKind::memory:
+					this->output.append_number(immediate(o.value));
+					this->output.append('(');
+					this->output.append(register_name(o.reg));
+					this->output.append(')');
+					break;
+				case OperandKind::none:
+					break;
+			}
+		}
+
+		// throws unless a number operand fits in an instruction's 32-bit immediate
+		void check_immediate(const Operand &o) {
+			if (o.kind == OperandKind::number) {
+				immediate(o.value);
+			}
+		}
+
+		// "  mnemonic source, destination"
+		void instruction(std::string_view mnemonic, const Operand &source, const Operand &destination) {
+			this->output.append("  ");
+			this->output.append(mnemonic);
+			this->output.append(' ');
+			this->operand(source);
+			this->output.append(", ");
+			this->operand(destination);
+			this->output.append('\n');
+		}
+
+		// "  mnemonic $value, destination"
+		void line(std::string_view mnemonic, std::string_view prefix, int64_t value, std::string_view destination) {
+			this->output.append("  ");
+			this->output.append(mnemonic);
+			this->output.append(' ');
+			this->output.append(prefix);
+			this->output.append_number(value);
+			this->output.append(", ");
+			this->output.append(destination);
+			this->output.append('\n');
+		}
+
+		void jump(std::string_view mnemonic, const Operand &target) {
+			this->output.append("  ");
+			this->output.append(mnemonic);
+			this->output.append(' ');
+			this->label(target);
+			this->output.append('\n');
+		}
+
+		// destination <- 1 if condition `cc` holds, 0 otherwise
+		void set(std::string_view cc, RegisterID destination) {
+			this->output.append("  set");
+			this->output.append(cc);
+			this->output.append(' ');
+			this->output.append(register_name_8(destination));
+			this->output.append("\n  movzbq ");
+			this->output.append(register_name_8(destination));
+			this->output.append(", ");
+			this->output.append(register_name(destination));
+			this->output.append('\n');
+		}
 
 		/*
-		 * Generate target code
+		 * Emits the cmpq for `lhs op rhs`, where at least one side is a
+		 * register, and returns the condition code that is true when the
+		 * comparison holds. cmpq only takes an immediate as its first
+		 * operand, so a constant lhs swaps the sides.
 		 */
-		//TODO
+		std::string_view compare(Operator op, const Operand &lhs, const Operand &rhs) {
+			this->check_immediate(lhs);
+			this->check_immediate(rhs);
+			if (lhs.kind == OperandKind::reg) {
+				this->instruction("cmpq", rhs, lhs);
+				return condition_code(op);
+			}
+			this->instruction("cmpq", lhs, rhs);
+			return swapped_condition_code(op);
+		}
+	};
+
+	// AssemblyGenerator methods
 
+	AssemblyGenerator::AssemblyGenerator(const std::string &outputFileName, const CodeGenerationOptions &options) :
+		output {outputFileName},
+		options {options},
+		num_counters {0}
+	{}
+
+	void AssemblyGenerator::begin(SymbolID entryPointLabel, const SymbolTable &symbols) {
 		/*
-		 * Close the output file.
+		 * "go" saves the callee-saved registers around the entry point.
 		 */
-		outputFile.close();
+		this->output.append(
+			"  .text\n"
+			"  .globl go\n"
+			"go:\n"
+			"  pushq %rbx\n"
+			"  pushq %rbp\n"
+			"  pushq %r12\n"
+			"  pushq %r13\n"
+			"  pushq %r14\n"
+			"  pushq %r15\n"
+			"  call _"
+		);
+		this->output.append(symbols.name(entryPointLabel));
+		this->output.append(
+			"\n"
+			"  popq %r15\n"
+			"  popq %r14\n"
+			"  popq %r13\n"
+			"  popq %r12\n"
+			"  popq %rbp\n"
+			"  popq %rbx\n"
+			"  retq\n"
+		);
+	}
+
+	void AssemblyGenerator::generate(const Function &f, const SymbolTable &symbols) {
+		this->output.append('_');
+		this->output.append(symbols.name(f.name));
+		this->output.append(":\n");
+
+		// the locals live between rsp and the return address
+		if (f.num_locals > 0) {
+			this->output.append("  subq $");
+			this->output.append_number(immediate(8 * f.num_locals));
+			this->output.append(", %rsp\n");
+		}
+
+		InstructionSelector selector(this->output, f, symbols);
+		CompareBranchFinder compare_branches(f);
+		if (!this->options.lay_out_blocks && !this->options.instrument) {
+			for (std::size_t k = 0; k < f.instructions.size(); k++) {
+				CompareBranch branch;
+				if (compare_branches.find(k, branch)) {
+					selector.compare_branch(branch, false, {&branch.cjump->label, 0});
+					k++;
+					continue;
+				}
+				f.instructions[k]->accept(selector);
+			}
+			return;
+		}
+
+		ControlFlowGraph cfg(f);
+		if (this->options.instrument) {
+			// a counter per block after its label, and one per branch after its jCC
+			std::vector<std::size_t> branches = profiled_branches(f, cfg);
+			std::size_t first_counter = this->num_counters;
+			std::size_t next_branch = 0;
+			for (std::size_t b = 0; b < cfg.blocks.size(); b++) {
+				const BasicBlock &block = cfg.blocks[b];
+				std::size_t k = block.begin;
+				if (dynamic_cast<const Instruction_label *>(f.instructions[k])) {
+					f.instructions[k++]->accept(selector);
+				}
+				this->count(first_counter + b);
+				for (; k < block.end; k++) {
+					CompareBranch branch;
+					if (compare_branches.find(k, branch)) {
+						selector.compare_branch(branch, false, {&branch.cjump->label, 0});
+						k++;
+						continue;
+					}
+					f.instructions[k]->accept(selector);
+				}
+				if (next_branch < branches.size() && branches[next_branch] == b) {
+					this->count(first_counter + cfg.blocks.size() + next_branch++);
+				}
+			}
+			this->instrumented.push_back({
+				symbols.name(f.name),
+				static_cast<uint32_t>(f.instructions.size()),
+				static_cast<uint32_t>(cfg.blocks.size()),
+				static_cast<uint32_t>(branches.size())
+			});
+			this->num_counters += cfg.blocks.size() + branches.size();
+			return;
+		}
+
+		FunctionProfile profile;
+		bool profiled = this->options.profile && this->options.profile->find(f, cfg, symbols, profile);
+		BlockLayout layout(f, cfg, profiled ? &profile : nullptr);
+		layout.write(f, cfg, compare_branches, selector);
+	}
+
+	void AssemblyGenerator::end(const SymbolTable &symbols) {
+		if (this->options.instrument) {
+			this->write_profile();
+		}
+		this->output.close();
+	}
+
+	void AssemblyGenerator::count(std::size_t counter) {
+		// the flags are never live from one L1 instruction to the next, so incq can go anywhere between them
+		this->output.append("  incq .Lprofile_counters+");
+		this->output.append_number(8 * counter);
+		this->output.append("(%rip)\n");
+	}
+
+	void AssemblyGenerator::write_profile() {
+		// the layout of Profile, with the counters in .data
+		this->output.append(
+			"  .data\n"
+			"  .p2align 3\n"
+			".Lprofile:\n"
+			"  .ascii \""
+		);
+		this->output.append(Profile::magic);
+		this->output.append("\"\n  .quad ");
+		this->output.append_number(this->instrumented.size());
+		this->output.append('\n');
+		for (const InstrumentedFunction &f : this->instrumented) {
+			this->output.append("  .long ");
+			this->output.append_number(f.name.size());
+			this->output.append(", ");
+			this->output.append_number(f.num_instructions);
+			this->output.append(", ");
+			this->output.append_number(f.num_blocks);
+			this->output.append(", ");
+			this->output.append_number(f.num_branches);
+			this->output.append("\n  .ascii \"");
+			this->output.append(f.name);
+			this->output.append("\"\n");
+		}
+		this->output.append(
+			"  .p2align 3\n"
+			".Lprofile_counters:\n"
+			"  .zero "
+		);
+		this->output.append_number(8 * this->num_counters);
+		this->output.append(
+			"\n"
+			".Lprofile_end:\n"
+			".Lprofile_file:\n"
+			"  .asciz \"prog.profile\"\n"
+			".Lprofile_mode:\n"
+			"  .asciz \"wb\"\n"
+
+			// run by exit(), including the exits of tuple-error and tensor-error
+			"  .section .fini_array, \"aw\"\n"
+			"  .p2align 3\n"
+			"  .quad .Lprofile_write\n"
+			"  .text\n"
+			".Lprofile_write:\n"
+			"  pushq %rbx\n"
+			"  leaq .Lprofile_file(%rip), %rdi\n"
+			"  leaq .Lprofile_mode(%rip), %rsi\n"
+			"  call fopen\n"
+			"  testq %rax, %rax\n"
+			"  je .Lprofile_written\n"
+			"  movq %rax, %rbx\n"
+			"  leaq .Lprofile(%rip), %rdi\n"
+			"  movq $1, %rsi\n"
+			"  movq $(.Lprofile_end - .Lprofile), %rdx\n"
+			"  movq %rbx, %rcx\n"
+			"  call fwrite\n"
+			"  movq %rbx, %rdi\n"
+			"  call fclose\n"
+			".Lprofile_written:\n"
+			"  popq %rbx\n"
+			"  retq\n"
+		);
+	}
+
+	std::unique_ptr<CodeGenerator> make_code_generator(OutputFormat format, const CodeGenerationOptions &options) {
+		if (format == OutputFormat::object) {
+			return std::make_unique<ObjectGenerator>("prog.o", options);
+		}
+		return std::make_unique<AssemblyGenerator>("prog.S", options);
+	}
 
-		return;
+	void generate_code(const Program &p, OutputFormat format, const CodeGenerationOptions &options){
+		std::unique_ptr<CodeGenerator> generator = make_code_generator(format, options);
+		generator->begin(p.entryPointLabel, p.symbols);
+		for (const Function *f : p.functions) {
+			generator->generate(*f, p.symbols);
+		}
+		generator->end(p.symbols);
 	}
 }
@@ -1,7 +1,96 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include <L1.h>
+#include <output_buffer.h>
+#include <profile.h>
 
 namespace L1 {
-	void generate_code(Program p);
+	enum struct OutputFormat {
+		assembly, // prog.S
+		object // prog.o, a relocatable ELF64 object
+	};
+
+	// what the code generators do besides selecting instructions
+	struct CodeGenerationOptions {
+		// write the blocks of each function in a BlockLayout's order
+		bool lay_out_blocks = false;
+
+		// counts for the layout, and for aligning hot loops; may be null
+		const Profile *profile = nullptr;
+
+		/*
+		 * Count how often every block runs and every cjump falls through,
+		 * and write the counts to prog.profile when the program exits. The
+		 * blocks stay in their order. Only the assembly generator does this.
+		 */
+		bool instrument = false;
+	};
+
+	/*
+	 * Code generator interface.
+	 * Code is generated one function at a time, so a function can be
+	 * released as soon as its code is generated.
+	 */
+	struct CodeGenerator {
+		virtual ~CodeGenerator() = default;
+
+		// the entry point wrapper; must come first
+		virtual void begin(SymbolID entryPointLabel, const SymbolTable &symbols) = 0;
+
+		virtual void generate(const Function &f, const SymbolTable &symbols) = 0;
+
+		virtual void end(const SymbolTable &symbols) = 0;
+	};
+
+	/*
+	 * Writes x86-64 assembly.
+	 */
+	class AssemblyGenerator : public CodeGenerator {
+		public:
+
+		AssemblyGenerator(const std::string &outputFileName, const CodeGenerationOptions &options = {});
+
+		virtual void begin(SymbolID entryPointLabel, const SymbolTable &symbols) override;
+		virtual void generate(const Function &f, const SymbolTable &symbols) override;
+		virtual void end(const SymbolTable &symbols) override;
+
+		private:
+
+		// what the profile says about each instrumented function
+		struct InstrumentedFunction {
+			std::string name;
+			uint32_t num_instructions;
+			uint32_t num_blocks;
+			uint32_t num_branches;
+		};
+
+		OutputBuffer output;
+		CodeGenerationOptions options;
+		std::vector<InstrumentedFunction> instrumented;
+		std::size_t num_counters;
+
+		// "  incq" of the counter
+		void count(std::size_t counter);
+		// the profile, its counters, and the code that writes them out
+		void write_profile();
+	};
+
+	/*
+	 * `value` as the sign-extended 32-bit immediate or displacement of an
+	 * instruction, and `count` as the 8-bit count of a shift. Both throw
+	 * std::runtime_error when the value doesn't fit, so that the assembly
+	 * and the object code generators accept the same programs.
+	 */
+	int32_t immediate(int64_t value);
+	uint8_t shift_count(int64_t count);
+
+	std::unique_ptr<CodeGenerator> make_code_generator(OutputFormat format, const CodeGenerationOptions &options = {});
+
+	void generate_code(const Program &p, OutputFormat format = OutputFormat::assembly, const CodeGenerationOptions &options = {});
 }
@@ -0,0 +1,112 @@
+#include <vector>
+
+#include <compare_branch.h>
+#include <liveness.h>
+
+namespace L1 {
+	// instructions the liveness scan looks at before giving up
+	static const int scan_budget = 64;
+
+	static bool is_register(const Operand &o, RegisterID r) {
+		return o.kind == OperandKind::reg && o.reg == r;
+	}
+
+	// CompareBranchFinder methods
+
+	CompareBranchFinder::CompareBranchFinder(const Function &f) : f {f}, labels_indexed {false} {}
+
+	bool CompareBranchFinder::find(std::size_t k, CompareBranch &branch) {
+		const std::vector<Instruction *> &instructions = this->f.instructions;
+		if (k + 1 >= instructions.size()) {
+			return false;
+		}
+		auto compare = dynamic_cast<const Instruction_compare_assignment *>(instructions[k]);
+		auto cjump = dynamic_cast<const Instruction_cjump *>(instructions[k + 1]);
+		if (!compare || !cjump) {
+			return false;
+		}
+
+		// the cjump has to compare w with a constant, and w is 0 or 1
+		RegisterID w = compare->destination.reg;
+		bool holds_if_0;
+		bool holds_if_1;
+		if (is_register(cjump->lhs, w) && cjump->rhs.kind == OperandKind::number) {
+			holds_if_0 = compare_constants(cjump->op, 0, cjump->rhs.value);
+			holds_if_1 = compare_constants(cjump->op, 1, cjump->rhs.value);
+		} else if (cjump->lhs.kind == OperandKind::number && is_register(cjump->rhs, w)) {
+			holds_if_0 = compare_constants(cjump->op, cjump->lhs.value, 0);
+			holds_if_1 = compare_constants(cjump->op, cjump->lhs.value, 1);
+		} else {
+			return false;
+		}
+		if (holds_if_0 == holds_if_1) {
+			return false;
+		}
+
+		branch.compare = compare;
+		branch.cjump = cjump;
+		branch.jump_if_true = holds_if_1;
+		int budget = scan_budget;
+		NextUse use = this->next_use(k + 2, w, budget);
+		if (use == NextUse::overwritten) {
+			use = this->next_use_at(cjump->label.symbol, w, budget);
+		}
+		branch.result_live = use != NextUse::overwritten;
+		return true;
+	}
+
+	CompareBranchFinder::NextUse CompareBranchFinder::next_use_at(SymbolID label, RegisterID r, int &budget) {
+		if (!this->labels_indexed) {
+			for (std::size_t k = 0; k < this->f.instructions.size(); k++) {
+				if (auto l = dynamic_cast<const Instruction_label *>(this->f.instructions[k])) {
+					this->label_indices[l->label.symbol] = k;
+				}
+			}
+			this->labels_indexed = true;
+		}
+		auto target = this->label_indices.find(label);
+		if (target == this->label_indices.end()) {
+			return NextUse::unknown;
+		}
+		return this->next_use(target->second, r, budget);
+	}
+
+	/*
+	 * What happens to r first when running from f.instructions[k] on: the
+	 * register effects of each instruction, as live_before combines them,
+	 * until one of them reads or writes r.
+	 */
+	CompareBranchFinder::NextUse CompareBranchFinder::next_use(std::size_t k, RegisterID r, int &budget) {
+		const std::vector<Instruction *> &instructions = this->f.instructions;
+		while (k < instructions.size()) {
+			if (budget-- <= 0) {
+				return NextUse::unknown;
+			}
+			Instruction *i = instructions[k];
+			RegisterEffects effects = register_effects(i);
+			if (contains(effects.reads, r)) {
+				return NextUse::read;
+			}
+			if (contains(effects.writes, r)) {
+				return NextUse::overwritten;
+			}
+			if (auto g = dynamic_cast<const Instruction_goto *>(i)) {
+				return this->next_use_at(g->label.symbol, r, budget);
+			}
+			if (auto c = dynamic_cast<const Instruction_cjump *>(i)) {
+				NextUse taken = this->next_use_at(c->label.symbol, r, budget);
+				if (taken != NextUse::overwritten) {
+					return taken;
+				}
+			} else if (dynamic_cast<const Instruction_ret *>(i)) {
+				return NextUse::overwritten;
+			} else if (dynamic_cast<const Instruction_call *>(i)) {
+				// where the callee returns to isn't known here
+				return NextUse::unknown;
+			}
+			k++;
+		}
+		// the function runs off its end
+		return NextUse::unknown;
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <unordered_map>
+
+#include <L1.h>
+
+namespace L1 {
+	/*
+	 * "w <- t cmp t" directly followed by a cjump that only tests w against
+	 * a constant, such as "cjump w = 1 :label". The code generators turn the
+	 * pair into a single compare and conditional jump.
+	 */
+	struct CompareBranch {
+		const Instruction_compare_assignment *compare;
+		const Instruction_cjump *cjump;
+
+		// jump when the comparison holds, or when it doesn't
+		bool jump_if_true;
+
+		// w may be read after the cjump, so it still has to be set
+		bool result_live;
+	};
+
+	/*
+	 * Finds the CompareBranch pairs of one function. Whether w is still live
+	 * comes from a short forward scan that follows jumps and applies the
+	 * register_effects of each instruction, so calls and returns follow the
+	 * L1 calling convention as they do for Liveness. When the scan can't
+	 * tell, w is live.
+	 */
+	class CompareBranchFinder {
+		public:
+
+		CompareBranchFinder(const Function &f);
+
+		// whether f.instructions[k] and f.instructions[k + 1] form a CompareBranch
+		bool find(std::size_t k, CompareBranch &branch);
+
+		private:
+
+		enum struct NextUse {
+			read,
+			overwritten,
+			unknown
+		};
+
+		const Function &f;
+		// built the first time a scan needs it
+		std::unordered_map<SymbolID, std::size_t> label_indices;
+		bool labels_indexed;
+
+		NextUse next_use(std::size_t k, RegisterID r, int &budget);
+		NextUse next_use_at(SymbolID label, RegisterID r, int &budget);
+	};
+}
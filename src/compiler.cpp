@@ -12,22 +12,63 @@
 #include <unistd.h>
 #include <iostream>
 #include <assert.h>
+#include <memory>
+#include <stdexcept>
 
 #include <parser.h>
 #include <code_generator.h>
+#include <peephole.h>
+#include <global_optimizer.h>
+#include <profile.h>
 
 void print_help(char *progName) {
-	std::cerr << "Usage: " << progName << " [-v] [-g 0|1] [-O 0|1|2] SOURCE" << std::endl;
+	std::cerr << "Usage: " << progName << " [-v] [-g 0|1] [-O 0|1|2] [-p pegtl|handwritten|parallel] [-s] [-f asm|obj] [-fprofile-generate | -fprofile-use=FILE] SOURCE" << std::endl;
+	std::cerr << "  -s: compile one function at a time, releasing each one once its code is written" << std::endl;
+	std::cerr << "  -f: write assembly to prog.S (default) or an ELF object to prog.o" << std::endl;
+	std::cerr << "  -fprofile-generate: the program counts how often each block runs and writes the counts to prog.profile when it exits (assembly only)" << std::endl;
+	std::cerr << "  -fprofile-use: lay out blocks and align hot loops from such counts; compile with the same -O level as the profiled program" << std::endl;
+	std::cerr << "  -O1: peephole optimizations, and blocks laid out so likely branches fall through and error paths come last; with -v, reports the instructions removed from each function" << std::endl;
+	std::cerr << "  -O2: also constant propagation and removal of dead register writes; assumes every function keeps to the calling convention" << std::endl;
 	return;
 }
 
+// runs the passes of `optLevel` on f
+void optimize_function(L1::Function &f, L1::Arena &arena, const L1::SymbolTable &symbols, int32_t optLevel, bool verbose) {
+	if (optLevel < 1) {
+		return;
+	}
+	std::size_t original_size = f.instructions.size();
+	std::size_t removed = 0;
+	if (optLevel >= 2) {
+		removed += L1::propagate_constants(f, arena);
+		removed += L1::remove_dead_writes(f);
+	}
+	removed += L1::peephole_optimize(f, arena);
+	if (verbose) {
+		std::cerr << "@" << symbols.name(f.name) << ": removed " << removed << " of " << original_size << " instructions" << std::endl;
+	}
+}
+
+void print_function(const L1::Function &f, const L1::SymbolTable &symbols) {
+	std::cout << "  (@" << symbols.name(f.name) << " " << f.num_arguments << " " << f.num_locals << std::endl;
+	for (const L1::Instruction *i : f.instructions) {
+		std::cout << "    " << i->toString(symbols) << std::endl;
+	}
+	std::cout << "  )" << std::endl;
+}
+
 int main(
 	int argc,
 	char **argv
 ) {
 	auto enable_code_generator = false;
 	int32_t optLevel = 0;
-	bool verbose;
+	bool verbose = false;
+	L1::ParserKind parser = L1::ParserKind::pegtl;
+	bool stream = false;
+	L1::OutputFormat format = L1::OutputFormat::assembly;
+	L1::CodeGenerationOptions generation;
+	std::unique_ptr<L1::Profile> profile;
 
 	/*
 	 * Check the compiler arguments.
@@ -37,7 +78,7 @@ int main(
 		return 1;
 	}
 	int32_t opt;
-	while ((opt = getopt(argc, argv, "vg:O:")) != -1) {
+	while ((opt = getopt(argc, argv, "vg:O:p:sf:")) != -1) {
 		switch (opt) {
 			case 'O':
 				optLevel = strtoul(optarg, NULL, 0);
@@ -48,35 +89,135 @@ int main(
 			case 'v':
 				verbose = true;
 				break;
+			case 's':
+				stream = true;
+				break;
+			case 'f':
+				if (strcmp(optarg, "asm") == 0) {
+					format = L1::OutputFormat::assembly;
+				} else if (strcmp(optarg, "obj") == 0) {
+					format = L1::OutputFormat::object;
+				} else if (strcmp(optarg, "profile-generate") == 0) {
+					generation.instrument = true;
+				} else if (strncmp(optarg, "profile-use=", 12) == 0) {
+					try {
+						profile = std::make_unique<L1::Profile>(optarg + 12);
+					} catch (const std::runtime_error &e) {
+						std::cerr << "L1: " << e.what() << std::endl;
+						return 1;
+					}
+				} else {
+					print_help(argv[0]);
+					return 1;
+				}
+				break;
+			case 'p':
+				if (!L1::parser_kind_from_string(optarg, parser)) {
+					print_help(argv[0]);
+					return 1;
+				}
+				break;
 			default:
 				print_help(argv[0]);
 				return 1;
 		}
 	}
 
+	if (generation.instrument && (format != L1::OutputFormat::assembly || profile)) {
+		print_help(argv[0]);
+		return 1;
+	}
+	generation.lay_out_blocks = (optLevel >= 1 || profile) && !generation.instrument;
+	generation.profile = profile.get();
+
+	/*
+	 * Streaming mode: every function goes through the whole pipeline right
+	 * after it is parsed.
+	 */
+	if (stream) {
+		std::unique_ptr<L1::CodeGenerator> generator;
+		if (enable_code_generator) {
+			generator = L1::make_code_generator(format, generation);
+		}
+		L1::SymbolTable symbols;
+		try {
+			L1::parse_file_streaming(
+				argv[optind],
+				symbols,
+				[&](L1::SymbolID entryPointLabel, const L1::SymbolTable &symbols) {
+					if (verbose) {
+						std::cout << "(@" << symbols.name(entryPointLabel) << std::endl;
+					}
+					if (generator) {
+						generator->begin(entryPointLabel, symbols);
+					}
+				},
+				[&](L1::Function &f, const L1::SymbolTable &symbols) {
+					// new instructions only need to live as long as the function
+					L1::Arena arena;
+					optimize_function(f, arena, symbols, optLevel, verbose);
+					if (verbose) {
+						print_function(f, symbols);
+					}
+					if (generator) {
+						generator->generate(f, symbols);
+					}
+				}
+			);
+			if (verbose) {
+				std::cout << ")" << std::endl;
+			}
+			if (generator) {
+				generator->end(symbols);
+			}
+		} catch (const std::runtime_error &e) {
+			std::cerr << "L1: " << e.what() << std::endl;
+			return 1;
+		}
+		return 0;
+	}
+
 	/*
 	 * Parse the input file.
 	 */
-	auto p = L1::parse_file(argv[optind]);
+	L1::Program p;
+	try {
+		p = L1::parse_file(argv[optind], parser);
+	} catch (const std::runtime_error &e) {
+		// tao::pegtl::parse_error is a std::runtime_error too
+		std::cerr << "L1: " << e.what() << std::endl;
+		return 1;
+	}
 
 	/*
 	 * Code optimizations (optional)
 	 */
+	for (L1::Function *f : p.functions) {
+		optimize_function(*f, p.arena, p.symbols, optLevel, verbose);
+	}
 
 	/*
 	 * Print the source program.
 	 */
 	if (verbose) {
-		for (auto f : p.functions) {
-			//TODO
+		std::cout << "(@" << p.symbols.name(p.entryPointLabel) << std::endl;
+		for (const L1::Function *f : p.functions) {
+			print_function(*f, p.symbols);
 		}
+		std::cout << ")" << std::endl;
 	}
 
 	/*
 	 * Generate x86_64 assembly.
 	 */
 	if (enable_code_generator) {
-		L1::generate_code(p);
+		// the object writer resolves labels itself, where the assembler would have left them to the linker
+		try {
+			L1::generate_code(p, format, generation);
+		} catch (const std::runtime_error &e) {
+			std::cerr << "L1: " << e.what() << std::endl;
+			return 1;
+		}
 	}
 
 	return 0;
@@ -0,0 +1,23 @@
+#include <dataflow.h>
+
+namespace L1 {
+	// OrderedWorklist methods
+
+	OrderedWorklist::OrderedWorklist(std::size_t size) : words((size + 63) / 64, ~uint64_t(0)), lowest {0} {
+		if (size % 64 != 0) {
+			this->words.back() = (uint64_t(1) << (size % 64)) - 1;
+		}
+	}
+
+	bool OrderedWorklist::take(std::size_t &p) {
+		for (std::size_t w = this->lowest / 64; w < this->words.size(); w++) {
+			if (this->words[w] != 0) {
+				p = w * 64 + __builtin_ctzll(this->words[w]);
+				this->words[w] &= this->words[w] - 1;
+				this->lowest = p + 1;
+				return true;
+			}
+		}
+		return false;
+	}
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <cfg.h>
+
+namespace L1 {
+	enum struct Direction {
+		forward,
+		backward
+	};
+
+	/*
+	 * The value of a dataflow problem at the start and the end of every
+	 * block, in program order: in[b] holds before the first instruction of
+	 * block b and out[b] after its last, whatever the direction.
+	 */
+	template <typename Set>
+	struct DataflowSolution {
+		std::vector<Set> in;
+		std::vector<Set> out;
+	};
+
+	/*
+	 * The positions 0 to size - 1 that are waiting, as a bitset that always
+	 * hands out the lowest one.
+	 */
+	class OrderedWorklist {
+		public:
+
+		// with every position waiting
+		OrderedWorklist(std::size_t size);
+
+		void add(std::size_t p) {
+			this->words[p / 64] |= uint64_t(1) << (p % 64);
+			if (p < this->lowest) {
+				this->lowest = p;
+			}
+		}
+
+		// the lowest waiting position, if there is one
+		bool take(std::size_t &p);
+
+		private:
+
+		std::vector<uint64_t> words;
+		// no position below this one is waiting
+		std::size_t lowest;
+	};
+
+	/*
+	 * Solves a dataflow problem over the blocks of a function. A Problem
+	 * provides:
+	 *
+	 *   using Set = ...;                  the value at one point
+	 *   Direction direction;
+	 *   Set initial() const;              the value before anything flows in
+	 *   Set boundary() const;             what flows in from outside the
+	 *                                     function: into the entry block
+	 *                                     going forward, or out of the blocks
+	 *                                     that leave the function going backward
+	 *   void join(Set &into, const Set &from) const;
+	 *   void transfer(std::size_t block, Set &s) const;
+	 *                                     from one end of the block to the
+	 *                                     other, in the problem's direction
+	 *
+	 * Sets must compare with ==. Blocks wait on a worklist that hands them
+	 * out in reverse postorder (postorder for backward problems), so most
+	 * blocks are only visited once all of their inputs are final, and
+	 * mostly the blocks of loops are visited more than once.
+	 */
+	template <typename Problem>
+	DataflowSolution<typename Problem::Set> solve(const ControlFlowGraph &cfg, const Problem &problem) {
+		using Set = typename Problem::Set;
+		std::size_t num_blocks = cfg.blocks.size();
+		DataflowSolution<Set> solution {
+			std::vector<Set>(num_blocks, problem.initial()),
+			std::vector<Set>(num_blocks, problem.initial())
+		};
+		bool forward = problem.direction == Direction::forward;
+		std::vector<std::size_t> order = cfg.reverse_postorder();
+		if (!forward) {
+			std::reverse(order.begin(), order.end());
+		}
+		const Set boundary = problem.boundary();
+
+		std::vector<std::size_t> position(num_blocks);
+		for (std::size_t p = 0; p < num_blocks; p++) {
+			position[order[p]] = p;
+		}
+		OrderedWorklist worklist(num_blocks);
+
+		std::size_t p;
+		while (worklist.take(p)) {
+			std::size_t b = order[p];
+			const BasicBlock &block = cfg.blocks[b];
+			const std::vector<std::size_t> &sources = forward ? block.predecessors : block.successors;
+			const std::vector<std::size_t> &sinks = forward ? block.successors : block.predecessors;
+			std::vector<Set> &sources_end = forward ? solution.out : solution.in;
+
+			Set s = problem.initial();
+			if (forward ? b == 0 : block.leaves_function) {
+				problem.join(s, boundary);
+			}
+			for (std::size_t source : sources) {
+				problem.join(s, sources_end[source]);
+			}
+			(forward ? solution.in : solution.out)[b] = s;
+			problem.transfer(b, s);
+			Set &end = forward ? solution.out[b] : solution.in[b];
+			if (s == end) {
+				continue;
+			}
+			end = std::move(s);
+			for (std::size_t sink : sinks) {
+				worklist.add(position[sink]);
+			}
+		}
+		return solution;
+	}
+}
@@ -0,0 +1,221 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <parser.h>
+#include <cfg.h>
+#include <liveness.h>
+#include <reaching_definitions.h>
+
+void print_help(char *progName) {
+	std::cerr << "Usage: " << progName << " [-r REPETITIONS] [-n INSTRUCTIONS] [SOURCE...]" << std::endl;
+	std::cerr << "  -n: also analyze a generated function of about INSTRUCTIONS instructions" << std::endl;
+	return;
+}
+
+static const L1::RegisterID generated_registers[] = {
+	L1::RegisterID::rax, L1::RegisterID::rbx, L1::RegisterID::rdx, L1::RegisterID::rdi,
+	L1::RegisterID::rsi, L1::RegisterID::r8, L1::RegisterID::r9, L1::RegisterID::r10,
+	L1::RegisterID::r11, L1::RegisterID::r12, L1::RegisterID::r13, L1::RegisterID::r14
+};
+
+/*
+ * A function with the mix of straight-line code, branches, loops and
+ * calls of compiled L1 code. The same size always gives the same function.
+ */
+static L1::Function *generate_function(L1::Program &p, int64_t size) {
+	uint64_t state = 0x9e3779b97f4a7c15;
+	auto random = [&state](uint64_t bound) {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		return state % bound;
+	};
+	auto reg = [&]() {
+		return L1::Operand::make_register(generated_registers[random(sizeof(generated_registers) / sizeof(generated_registers[0]))]);
+	};
+
+	// a label every 6 instructions; jumps go to one of the 16 labels around them
+	const int64_t label_spacing = 6;
+	int64_t num_labels = size / label_spacing + 1;
+	std::vector<L1::SymbolID> labels;
+	for (int64_t l = 0; l < num_labels; l++) {
+		labels.push_back(p.symbols.intern("bench_" + std::to_string(l)));
+	}
+	auto nearby_label = [&](int64_t k) {
+		int64_t l = k / label_spacing + (int64_t)random(16) - 8;
+		return L1::Operand::make_label(labels[l < 0 ? 0 : l >= num_labels ? num_labels - 1 : l]);
+	};
+
+	auto f = p.arena.make<L1::Function>();
+	f->name = p.symbols.intern("bench");
+	f->num_arguments = 0;
+	f->num_locals = 1;
+	for (int64_t k = 0; k < size - 1; k++) {
+		if (k % label_spacing == 0) {
+			auto l = p.arena.make<L1::Instruction_label>();
+			l->label = L1::Operand::make_label(labels[k / label_spacing]);
+			f->instructions.push_back(l);
+			continue;
+		}
+		switch (random(12)) {
+			case 0:
+			case 1: {
+				auto a = p.arena.make<L1::Instruction_assignment>();
+				a->destination = reg();
+				a->source = random(2) ? reg() : L1::Operand::make_number(random(100));
+				f->instructions.push_back(a);
+				break;
+			}
+			case 2:
+			case 3:
+			case 4: {
+				static const L1::Operator ops[] = {L1::Operator::plus, L1::Operator::minus, L1::Operator::times, L1::Operator::bitwise_and};
+				auto a = p.arena.make<L1::Instruction_arithmetic>();
+				a->op = ops[random(4)];
+				a->destination = reg();
+				a->source = random(2) ? reg() : L1::Operand::make_number(random(100));
+				f->instructions.push_back(a);
+				break;
+			}
+			case 5: {
+				auto c = p.arena.make<L1::Instruction_compare_assignment>();
+				c->op = L1::Operator::lt;
+				c->destination = reg();
+				c->lhs = reg();
+				c->rhs = reg();
+				f->instructions.push_back(c);
+				break;
+			}
+			case 6: {
+				auto a = p.arena.make<L1::Instruction_assignment>();
+				a->destination = L1::Operand::make_memory(L1::RegisterID::rsp, 0);
+				a->source = reg();
+				f->instructions.push_back(a);
+				break;
+			}
+			case 7: {
+				auto a = p.arena.make<L1::Instruction_assignment>();
+				a->destination = reg();
+				a->source = L1::Operand::make_memory(L1::RegisterID::rsp, 0);
+				f->instructions.push_back(a);
+				break;
+			}
+			case 8:
+			case 9: {
+				auto c = p.arena.make<L1::Instruction_cjump>();
+				c->op = L1::Operator::lt;
+				c->lhs = reg();
+				c->rhs = reg();
+				c->label = nearby_label(k);
+				f->instructions.push_back(c);
+				break;
+			}
+			case 10: {
+				auto c = p.arena.make<L1::Instruction_call_runtime>();
+				c->function = L1::RuntimeFunction::print;
+				c->num_arguments = 1;
+				f->instructions.push_back(c);
+				break;
+			}
+			default: {
+				auto n = p.arena.make<L1::Instruction_increment>();
+				n->destination = reg();
+				f->instructions.push_back(n);
+				break;
+			}
+		}
+	}
+	f->instructions.push_back(p.arena.make<L1::Instruction_ret>());
+	return f;
+}
+
+/*
+ * Builds the CFG of every function and runs the analyses on it several
+ * times, and reports the time each step takes per repetition.
+ */
+static void benchmark(const std::string &name, const std::vector<L1::Function *> &functions, int64_t repetitions) {
+	using clock = std::chrono::steady_clock;
+	std::chrono::duration<double> cfg_time {0};
+	std::chrono::duration<double> liveness_time {0};
+	std::chrono::duration<double> reaching_time {0};
+	std::chrono::duration<double> loops_time {0};
+	std::size_t num_instructions = 0;
+	std::size_t num_blocks = 0;
+	std::size_t num_loops = 0;
+	for (int64_t r = 0; r < repetitions; r++) {
+		for (const L1::Function *f : functions) {
+			auto start = clock::now();
+			L1::ControlFlowGraph cfg(*f);
+			auto built = clock::now();
+			L1::Liveness liveness(*f, cfg);
+			auto live = clock::now();
+			L1::ReachingDefinitions reaching(*f, cfg);
+			auto reached = clock::now();
+			L1::Dominators dominators(cfg);
+			L1::LoopNest loops(cfg, dominators);
+			auto end = clock::now();
+			cfg_time += built - start;
+			liveness_time += live - built;
+			reaching_time += reached - live;
+			loops_time += end - reached;
+			if (r == 0) {
+				num_instructions += f->instructions.size();
+				num_blocks += cfg.blocks.size();
+				num_loops += loops.loops.size();
+			}
+		}
+	}
+
+	std::cout << name << ": "
+		<< num_instructions << " instructions, "
+		<< num_blocks << " blocks, "
+		<< num_loops << " loops, "
+		<< cfg_time.count() / repetitions * 1000 << " ms CFG, "
+		<< liveness_time.count() / repetitions * 1000 << " ms liveness, "
+		<< reaching_time.count() / repetitions * 1000 << " ms reaching definitions, "
+		<< loops_time.count() / repetitions * 1000 << " ms dominators and loops" << std::endl;
+}
+
+int main(
+	int argc,
+	char **argv
+) {
+	int64_t repetitions = 10;
+	int64_t generated_size = 0;
+
+	int32_t opt;
+	while ((opt = getopt(argc, argv, "r:n:")) != -1) {
+		switch (opt) {
+			case 'r':
+				repetitions = strtoul(optarg, NULL, 0);
+				break;
+			case 'n':
+				generated_size = strtoul(optarg, NULL, 0);
+				break;
+			default:
+				print_help(argv[0]);
+				return 1;
+		}
+	}
+	if (optind >= argc && generated_size <= 0) {
+		print_help(argv[0]);
+		return 1;
+	}
+
+	for (int32_t arg = optind; arg < argc; arg++) {
+		L1::Program p = L1::parse_file(argv[arg]);
+		benchmark(argv[arg], p.functions, repetitions);
+	}
+	if (generated_size > 0) {
+		L1::Program p;
+		L1::Function *f = generate_function(p, generated_size);
+		benchmark("generated", {f}, repetitions);
+	}
+
+	return 0;
+}
@@ -0,0 +1,506 @@
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <unordered_set>
+#include <vector>
+
+#include <cfg.h>
+#include <global_optimizer.h>
+#include <liveness.h>
+
+namespace L1 {
+	// constants instructions other than "w <- N" can encode
+	static bool fits_in_immediate(int64_t value) {
+		return value >= INT32_MIN && value <= INT32_MAX;
+	}
+
+	// the label an instruction takes the address of or defines, and whether it calls a function
+	struct ReturnLabelVisitor : InstructionVisitor {
+		const Operand *taken = nullptr;
+		const Operand *label = nullptr;
+		bool call = false;
+
+		virtual void visit(Instruction_ret &i) override {}
+
+		virtual void visit(Instruction_assignment &i) override {
+			if (i.source.kind == OperandKind::label) {
+				this->taken = &i.source;
+			}
+		}
+
+		virtual void visit(Instruction_arithmetic &i) override {}
+		virtual void visit(Instruction_shift &i) override {}
+		virtual void visit(Instruction_compare_assignment &i) override {}
+		virtual void visit(Instruction_cjump &i) override {}
+
+		virtual void visit(Instruction_label &i) override {
+			this->label = &i.label;
+		}
+
+		virtual void visit(Instruction_goto &i) override {}
+
+		virtual void visit(Instruction_call &i) override {
+			this->call = true;
+		}
+
+		virtual void visit(Instruction_call_runtime &i) override {}
+		virtual void visit(Instruction_increment &i) override {}
+		virtual void visit(Instruction_decrement &i) override {}
+		virtual void visit(Instruction_lea &i) override {}
+	};
+
+	/*
+	 * Whether every label the function takes the address of directly
+	 * follows a call, so that control only gets there by returning from it.
+	 */
+	static bool return_labels_follow_calls(const Function &f) {
+		std::unordered_set<SymbolID> taken;
+		for (Instruction *i : f.instructions) {
+			ReturnLabelVisitor v;
+			i->accept(v);
+			if (v.taken) {
+				taken.insert(v.taken->symbol);
+			}
+		}
+		bool after_call = false;
+		for (std::size_t k = 0; k < f.instructions.size() && !taken.empty(); k++) {
+			ReturnLabelVisitor v;
+			f.instructions[k]->accept(v);
+			if (v.label && taken.count(v.label->symbol) && !after_call) {
+				return false;
+			}
+			after_call = v.call;
+		}
+		return true;
+	}
+
+	// the registers known to hold a constant at one point of a function
+	struct Constants {
+		RegisterSet known;
+		int64_t values[16];
+	};
+
+	static bool constant_of(const Constants &c, const Operand &o, int64_t &value) {
+		if (o.kind == OperandKind::number) {
+			value = o.value;
+			return true;
+		}
+		if (o.kind == OperandKind::reg && contains(c.known, o.reg)) {
+			value = c.values[static_cast<int>(o.reg)];
+			return true;
+		}
+		return false;
+	}
+
+	// keeps what both `c` and `other` know; returns whether `c` changed
+	static bool meet(Constants &c, const Constants &other) {
+		RegisterSet known = c.known & other.known;
+		for (int r = 0; r < 16; r++) {
+			if ((known >> r & 1) && c.values[r] != other.values[r]) {
+				known &= ~(1u << r);
+			}
+		}
+		bool changed = known != c.known;
+		c.known = known;
+		return changed;
+	}
+
+	// what the machine computes, wrapping around on overflow
+	static int64_t apply(Operator op, int64_t lhs, int64_t rhs) {
+		uint64_t l = lhs;
+		uint64_t r = rhs;
+		switch (op) {
+			case Operator::plus: return static_cast<int64_t>(l + r);
+			case Operator::minus: return static_cast<int64_t>(l - r);
+			case Operator::times: return static_cast<int64_t>(l * r);
+			case Operator::bitwise_and: return static_cast<int64_t>(l & r);
+			// x86 only uses the low 6 bits of the count
+			case Operator::lshift: return static_cast<int64_t>(l << (r & 63));
+			case Operator::rshift: return lhs >> (r & 63);
+			case Operator::lt:
+			case Operator::le:
+			case Operator::eq: return compare_constants(op, lhs, rhs);
+		}
+		return 0;
+	}
+
+	/*
+	 * Whether an instruction sets a register to a value known from the
+	 * constants before it; if so, which register and what value.
+	 */
+	struct ConstantVisitor : InstructionVisitor {
+		const Constants &c;
+		bool constant = false;
+		RegisterID destination;
+		int64_t value;
+
+		// a cjump on known operands only goes one way: to its label if `jumps`
+		bool decided = false;
+		bool jumps;
+
+		ConstantVisitor(const Constants &c) : c {c} {}
+
+		// `destination` gets `lhs op rhs`, if both are known
+		void set(const Operand &destination, Operator op, const Operand &lhs, const Operand &rhs) {
+			int64_t l;
+			int64_t r;
+			if (destination.kind == OperandKind::reg && constant_of(this->c, lhs, l) && constant_of(this->c, rhs, r)) {
+				this->constant = true;
+				this->destination = destination.reg;
+				this->value = apply(op, l, r);
+			}
+		}
+
+		virtual void visit(Instruction_ret &i) override {}
+
+		virtual void visit(Instruction_assignment &i) override {
+			if (i.destination.kind == OperandKind::reg && constant_of(this->c, i.source, this->value)) {
+				this->constant = true;
+				this->destination = i.destination.reg;
+			}
+		}
+
+		virtual void visit(Instruction_arithmetic &i) override {
+			this->set(i.destination, i.op, i.destination, i.source);
+		}
+
+		virtual void visit(Instruction_shift &i) override {
+			this->set(i.destination, i.op, i.destination, i.source);
+		}
+
+		virtual void visit(Instruction_compare_assignment &i) override {
+			this->set(i.destination, i.op, i.lhs, i.rhs);
+		}
+
+		virtual void visit(Instruction_cjump &i) override {
+			int64_t lhs;
+			int64_t rhs;
+			if (constant_of(this->c, i.lhs, lhs) && constant_of(this->c, i.rhs, rhs)) {
+				this->decided = true;
+				this->jumps = compare_constants(i.op, lhs, rhs);
+			}
+		}
+
+		virtual void visit(Instruction_label &i) override {}
+		virtual void visit(Instruction_goto &i) override {}
+		virtual void visit(Instruction_call &i) override {}
+		virtual void visit(Instruction_call_runtime &i) override {}
+
+		virtual void visit(Instruction_increment &i) override {
+			this->set(i.destination, Operator::plus, i.destination, Operand::make_number(1));
+		}
+
+		virtual void visit(Instruction_decrement &i) override {
+			this->set(i.destination, Operator::minus, i.destination, Operand::make_number(1));
+		}
+
+		virtual void visit(Instruction_lea &i) override {
+			int64_t base;
+			int64_t index;
+			if (constant_of(this->c, i.base, base) && constant_of(this->c, i.index, index)) {
+				this->constant = true;
+				this->destination = i.destination.reg;
+				this->value = apply(Operator::plus, base, apply(Operator::times, index, i.scale));
+			}
+		}
+	};
+
+	// updates `c` to after `i`; the registers `i` writes are known only if it computes them from constants
+	static void transfer(Instruction *i, Constants &c) {
+		ConstantVisitor visitor(c);
+		i->accept(visitor);
+		c.known &= ~register_effects(i).writes;
+		if (visitor.constant) {
+			c.known |= register_set(visitor.destination);
+			c.values[static_cast<int>(visitor.destination)] = visitor.value;
+		}
+	}
+
+	// a register with a known value becomes that value, if the instruction can encode it
+	static void substitute(Operand &o, const Constants &c) {
+		int64_t value;
+		if (o.kind == OperandKind::reg && constant_of(c, o, value) && fits_in_immediate(value)) {
+			o = Operand::make_number(value);
+		}
+	}
+
+	/*
+	 * What an instruction that doesn't compute a constant becomes given
+	 * the constants before it: itself, possibly with some operands
+	 * replaced, a goto, or nullptr if it does nothing.
+	 */
+	struct RewriteVisitor : InstructionVisitor {
+		const Constants &c;
+		Arena &arena;
+		Instruction *result = nullptr;
+
+		RewriteVisitor(const Constants &c, Arena &arena) : c {c}, arena {arena} {}
+
+		virtual void visit(Instruction_ret &i) override {
+			this->result = &i;
+		}
+
+		virtual void visit(Instruction_assignment &i) override {
+			if (i.destination.kind == OperandKind::memory) {
+				substitute(i.source, this->c);
+			}
+			this->result = &i;
+		}
+
+		virtual void visit(Instruction_arithmetic &i) override {
+			substitute(i.source, this->c);
+			this->result = &i;
+		}
+
+		virtual void visit(Instruction_shift &i) override {
+			int64_t count;
+			if (constant_of(this->c, i.source, count)) {
+				i.source = Operand::make_number(count & 63);
+			}
+			this->result = &i;
+		}
+
+		virtual void visit(Instruction_compare_assignment &i) override {
+			substitute(i.lhs, this->c);
+			substitute(i.rhs, this->c);
+			this->result = &i;
+		}
+
+		virtual void visit(Instruction_cjump &i) override {
+			int64_t lhs;
+			int64_t rhs;
+			if (constant_of(this->c, i.lhs, lhs) && constant_of(this->c, i.rhs, rhs)) {
+				if (apply(i.op, lhs, rhs)) {
+					auto g = this->arena.make<Instruction_goto>();
+					g->label = i.label;
+					this->result = g;
+				}
+				return;
+			}
+			substitute(i.lhs, this->c);
+			substitute(i.rhs, this->c);
+			this->result = &i;
+		}
+
+		virtual void visit(Instruction_label &i) override {
+			this->result = &i;
+		}
+
+		virtual void visit(Instruction_goto &i) override {
+			this->result = &i;
+		}
+
+		virtual void visit(Instruction_call &i) override {
+			this->result = &i;
+		}
+
+		virtual void visit(Instruction_call_runtime &i) override {
+			this->result = &i;
+		}
+
+		virtual void visit(Instruction_increment &i) override {
+			this->result = &i;
+		}
+
+		virtual void visit(Instruction_decrement &i) override {
+			this->result = &i;
+		}
+
+		virtual void visit(Instruction_lea &i) override {
+			this->result = &i;
+		}
+	};
+
+	/*
+	 * The instruction that does the same as `i` given the constants in `c`:
+	 * "w <- N" if it computes a constant, and otherwise what RewriteVisitor
+	 * makes of it.
+	 */
+	static Instruction *rewrite(Instruction *i, const Constants &c, Arena &arena) {
+		ConstantVisitor constant(c);
+		i->accept(constant);
+		if (constant.constant) {
+			auto a = arena.make<Instruction_assignment>();
+			a->destination = Operand::make_register(constant.destination);
+			a->source = Operand::make_number(constant.value);
+			return a;
+		}
+		RewriteVisitor visitor(c, arena);
+		i->accept(visitor);
+		return visitor.result;
+	}
+
+	std::size_t propagate_constants(Function &f, Arena &arena) {
+		if (f.instructions.empty() || !return_labels_follow_calls(f)) {
+			return 0;
+		}
+		ControlFlowGraph cfg(f);
+		std::size_t num_blocks = cfg.blocks.size();
+
+		// what is known at the start of each block, on the paths that can run
+		std::vector<Constants> in(num_blocks);
+		std::vector<bool> reached(num_blocks, false);
+		std::vector<bool> queued(num_blocks, false);
+		std::deque<std::size_t> worklist;
+		in[0].known = 0;
+		reached[0] = true;
+		queued[0] = true;
+		worklist.push_back(0);
+
+		auto flow = [&](std::size_t to, const Constants &c) {
+			bool changed;
+			if (reached[to]) {
+				changed = meet(in[to], c);
+			} else {
+				in[to] = c;
+				reached[to] = true;
+				changed = true;
+			}
+			if (changed && !queued[to]) {
+				queued[to] = true;
+				worklist.push_back(to);
+			}
+		};
+
+		while (!worklist.empty()) {
+			std::size_t b = worklist.front();
+			worklist.pop_front();
+			queued[b] = false;
+			const BasicBlock &block = cfg.blocks[b];
+			Constants c = in[b];
+			for (std::size_t k = block.begin; k < block.end; k++) {
+				transfer(f.instructions[k], c);
+			}
+
+			// a cjump on constants only goes one way
+			ConstantVisitor branch(c);
+			f.instructions[block.end - 1]->accept(branch);
+			if (branch.decided) {
+				if (branch.jumps) {
+					ControlFlowVisitor jump;
+					f.instructions[block.end - 1]->accept(jump);
+					auto target = cfg.label_blocks.find(jump.target->symbol);
+					if (target != cfg.label_blocks.end()) {
+						flow(target->second, c);
+					}
+				} else if (b + 1 < num_blocks) {
+					flow(b + 1, c);
+				}
+				continue;
+			}
+			for (std::size_t s : block.successors) {
+				flow(s, c);
+			}
+		}
+
+		std::vector<Instruction *> kept;
+		kept.reserve(f.instructions.size());
+		for (std::size_t b = 0; b < num_blocks; b++) {
+			const BasicBlock &block = cfg.blocks[b];
+			if (!reached[b]) {
+				for (std::size_t k = block.begin; k < block.end; k++) {
+					ControlFlowVisitor v;
+					f.instructions[k]->accept(v);
+					if (v.label) {
+						kept.push_back(f.instructions[k]);
+					}
+				}
+				continue;
+			}
+			Constants c = in[b];
+			for (std::size_t k = block.begin; k < block.end; k++) {
+				Instruction *i = f.instructions[k];
+				Instruction *replacement = rewrite(i, c, arena);
+				transfer(i, c);
+				if (replacement) {
+					kept.push_back(replacement);
+				}
+			}
+		}
+		std::size_t removed = f.instructions.size() - kept.size();
+		f.instructions = std::move(kept);
+		return removed;
+	}
+
+	// whether an instruction does nothing but write one register
+	struct PureWriteVisitor : InstructionVisitor {
+		bool only_writes_register = false;
+
+		virtual void visit(Instruction_ret &i) override {}
+
+		virtual void visit(Instruction_assignment &i) override {
+			this->only_writes_register = i.destination.kind == OperandKind::reg;
+		}
+
+		virtual void visit(Instruction_arithmetic &i) override {
+			this->only_writes_register = i.destination.kind == OperandKind::reg;
+		}
+
+		virtual void visit(Instruction_shift &i) override {
+			this->only_writes_register = true;
+		}
+
+		virtual void visit(Instruction_compare_assignment &i) override {
+			this->only_writes_register = true;
+		}
+
+		virtual void visit(Instruction_cjump &i) override {}
+		virtual void visit(Instruction_label &i) override {}
+		virtual void visit(Instruction_goto &i) override {}
+		virtual void visit(Instruction_call &i) override {}
+		virtual void visit(Instruction_call_runtime &i) override {}
+
+		virtual void visit(Instruction_increment &i) override {
+			this->only_writes_register = true;
+		}
+
+		virtual void visit(Instruction_decrement &i) override {
+			this->only_writes_register = true;
+		}
+
+		virtual void visit(Instruction_lea &i) override {
+			this->only_writes_register = true;
+		}
+	};
+
+	static bool only_writes_register(Instruction *i) {
+		PureWriteVisitor visitor;
+		i->accept(visitor);
+		return visitor.only_writes_register;
+	}
+
+	std::size_t remove_dead_writes(Function &f) {
+		if (!return_labels_follow_calls(f)) {
+			return 0;
+		}
+		std::size_t original_size = f.instructions.size();
+
+		// removing a write can make the writes that fed it dead in other blocks
+		bool changed = true;
+		while (changed && !f.instructions.empty()) {
+			ControlFlowGraph cfg(f);
+			Liveness liveness(f, cfg);
+			std::vector<bool> dead(f.instructions.size(), false);
+			changed = false;
+			for (std::size_t b = 0; b < cfg.blocks.size(); b++) {
+				const BasicBlock &block = cfg.blocks[b];
+				RegisterSet live = liveness.live_out[b];
+				for (std::size_t k = block.end; k-- > block.begin;) {
+					Instruction *i = f.instructions[k];
+					if (only_writes_register(i) && (register_effects(i).writes & live) == 0) {
+						dead[k] = true;
+						changed = true;
+						continue;
+					}
+					live = live_before(i, live);
+				}
+			}
+			std::size_t k = 0;
+			auto end = std::remove_if(f.instructions.begin(), f.instructions.end(), [&dead, &k](Instruction *) {
+				return dead[k++];
+			});
+			f.instructions.erase(end, f.instructions.end());
+		}
+		return original_size - f.instructions.size();
+	}
+}
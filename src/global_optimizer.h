@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+
+#include <L1.h>
+
+namespace L1 {
+	/*
+	 * The -O2 passes: they look at a whole function through its control
+	 * flow graph instead of a few instructions at a time.
+	 *
+	 * Both assume that every function keeps to the L1 calling convention
+	 * (see register_effects), and that every label whose address the
+	 * function takes is the return point of the call right before it;
+	 * functions that break the latter are left alone. Each returns the
+	 * number of instructions it removed.
+	 */
+
+	/*
+	 * Finds the registers that hold the same constant on every path to an
+	 * instruction, and uses those constants: instructions whose operands are
+	 * all constant become "w <- N" (or a goto, or nothing, for a cjump), and
+	 * other register operands with a known value become numbers. Branches
+	 * that can never be taken are not followed, and the code they lead to is
+	 * removed, apart from its labels. New instructions are allocated in
+	 * `arena`.
+	 */
+	std::size_t propagate_constants(Function &f, Arena &arena);
+
+	/*
+	 * Removes instructions whose only effect is to write a register that is
+	 * never read afterwards.
+	 */
+	std::size_t remove_dead_writes(Function &f);
+}
@@ -0,0 +1,11 @@
+#include <iostream>
+
+#include <parser.h>
+
+int main() {
+	if (L1::analyze_grammar() != 0) {
+		std::cerr << "There are problems with the grammar" << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,1151 @@
+/*
+ * A hand-written recursive-descent parser for L1.
+ *
+ * The PEGTL grammar in parser.cpp is the reference; every function below
+ * mirrors one of its rules (same name where possible) and makes the same
+ * choices in the same order, so both parsers accept exactly the same files
+ * and build the same Program. Like the grammar, the parser works directly on
+ * the characters of the mapped file: L1 is whitespace sensitive (instructions
+ * start at the beginning of a line, spaces between tokens are optional), so
+ * the lexer is driven by the parser and only asked for the token the parser
+ * expects next. Character classes come from a 256-entry table.
+ *
+ * Functions returning bool leave the position unchanged when they fail.
+ */
+#include <string>
+#include <string_view>
+#include <stdexcept>
+#include <charconv>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <cstring>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <L1.h>
+#include <handwritten_parser.h>
+
+namespace L1 {
+
+	/*
+	 * Character classes.
+	 */
+	enum : uint8_t {
+		char_space = 1 << 0, // ' ' and '\t'
+		char_name_start = 1 << 1, // letters and '_'
+		char_digit = 1 << 2
+	};
+
+	struct CharTable {
+		uint8_t classes[256];
+
+		constexpr CharTable() : classes {} {
+			this->classes[(unsigned char)' '] = char_space;
+			this->classes[(unsigned char)'\t'] = char_space;
+			this->classes[(unsigned char)'_'] = char_name_start;
+			for (int c = 'a'; c <= 'z'; c++) {
+				this->classes[c] = char_name_start;
+			}
+			for (int c = 'A'; c <= 'Z'; c++) {
+				this->classes[c] = char_name_start;
+			}
+			for (int c = '0'; c <= '9'; c++) {
+				this->classes[c] = char_digit;
+			}
+		}
+	};
+
+	static constexpr CharTable char_table;
+
+	static inline bool has_class(char c, uint8_t cls) {
+		return char_table.classes[(unsigned char)c] & cls;
+	}
+
+	/*
+	 * Read-only mapping of the whole input file.
+	 */
+	struct MappedFile {
+		const char *data;
+		size_t size;
+
+		MappedFile(const char *fileName) : data {nullptr}, size {0} {
+			int fd = open(fileName, O_RDONLY);
+			if (fd < 0) {
+				throw std::runtime_error(std::string("unable to open ") + fileName);
+			}
+			struct stat st;
+			if (fstat(fd, &st) != 0) {
+				close(fd);
+				throw std::runtime_error(std::string("unable to stat ") + fileName);
+			}
+			this->size = st.st_size;
+			if (this->size > 0) {
+				void *mapping = mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (mapping == MAP_FAILED) {
+					close(fd);
+					throw std::runtime_error(std::string("unable to map ") + fileName);
+				}
+				this->data = static_cast<const char *>(mapping);
+			}
+			close(fd);
+		}
+
+		// lets the kernel drop the pages before `position`; they are read again if needed
+		void release_before(const char *position) {
+			uintptr_t page_size = sysconf(_SC_PAGESIZE);
+			uintptr_t start = reinterpret_cast<uintptr_t>(this->data);
+			uintptr_t stop = reinterpret_cast<uintptr_t>(position) & ~(page_size - 1);
+			if (stop > start) {
+				madvise(const_cast<char *>(this->data), stop - start, MADV_DONTNEED);
+			}
+		}
+
+		MappedFile(const MappedFile &) = delete;
+		MappedFile &operator=(const MappedFile &) = delete;
+
+		~MappedFile() {
+			if (this->data) {
+				munmap(const_cast<char *>(this->data), this->size);
+			}
+		}
+	};
+
+	/*
+	 * Lexer.
+	 */
+	class Lexer {
+		public:
+
+		Lexer(const char *begin, const char *end, const char *fileName) :
+			begin {begin},
+			cursor {begin},
+			end {end},
+			fileName {fileName}
+		{}
+
+		const char *position() const {
+			return this->cursor;
+		}
+
+		void rewind(const char *position) {
+			this->cursor = position;
+		}
+
+		bool at_end() const {
+			return this->cursor == this->end;
+		}
+
+		// "bol": at the start of a line
+		bool at_bol() const {
+			return this->cursor == this->begin || this->cursor[-1] == '\n';
+		}
+
+		bool peek(char c) const {
+			return this->cursor != this->end && *this->cursor == c;
+		}
+
+		// "spaces": any number of blanks
+		void skip_spaces() {
+			while (this->cursor != this->end && has_class(*this->cursor, char_space)) {
+				this->cursor++;
+			}
+		}
+
+		bool character(char c) {
+			if (this->peek(c)) {
+				this->cursor++;
+				return true;
+			}
+			return false;
+		}
+
+		// a keyword or operator; like TAO_PEGTL_STRING this matches a prefix
+		template<size_t N>
+		bool literal(const char (&text)[N]) {
+			size_t length = N - 1;
+			if ((size_t)(this->end - this->cursor) >= length && std::memcmp(this->cursor, text, length) == 0) {
+				this->cursor += length;
+				return true;
+			}
+			return false;
+		}
+
+		// "eol": "\n" or "\r\n"
+		bool eol() {
+			if (this->character('\n')) {
+				return true;
+			}
+			if (this->end - this->cursor >= 2 && this->cursor[0] == '\r' && this->cursor[1] == '\n') {
+				this->cursor += 2;
+				return true;
+			}
+			return false;
+		}
+
+		// "//" up to and including the end of the line (or file)
+		bool comment() {
+			if (!this->literal("//")) {
+				return false;
+			}
+			while (!this->at_end() && !this->eol()) {
+				this->cursor++;
+			}
+			return true;
+		}
+
+		// "name": [A-Za-z_][A-Za-z_0-9]*
+		bool name(std::string_view &name) {
+			const char *start = this->cursor;
+			if (this->at_end() || !has_class(*this->cursor, char_name_start)) {
+				return false;
+			}
+			while (this->cursor != this->end && has_class(*this->cursor, char_name_start | char_digit)) {
+				this->cursor++;
+			}
+			name = std::string_view(start, this->cursor - start);
+			return true;
+		}
+
+		// "number": [+-]?[1-9][0-9]* or 0
+		bool number(int64_t &value) {
+			const char *start = this->cursor;
+			if (this->character('0')) {
+				value = 0;
+				return true;
+			}
+			bool plus = this->character('+');
+			if (!plus) {
+				this->character('-');
+			}
+			if (this->at_end() || *this->cursor < '1' || *this->cursor > '9') {
+				this->cursor = start;
+				return false;
+			}
+			while (this->cursor != this->end && has_class(*this->cursor, char_digit)) {
+				this->cursor++;
+			}
+			// from_chars doesn't accept an explicit plus sign
+			if (std::from_chars(start + plus, this->cursor, value).ec != std::errc()) {
+				this->cursor = start;
+				this->error("number out of range");
+			}
+			return true;
+		}
+
+		// one of the 16 register names, matched by prefix like the grammar
+		bool register_name(RegisterID &id) {
+			size_t available = this->end - this->cursor;
+			if (available < 2 || this->cursor[0] != 'r') {
+				return false;
+			}
+			char c1 = this->cursor[1];
+			char c2 = available >= 3 ? this->cursor[2] : '\0';
+			size_t length = 3;
+			switch (c1) {
+				case 'a': if (c2 != 'x') return false; id = RegisterID::rax; break;
+				case 'b':
+					if (c2 == 'x') id = RegisterID::rbx;
+					else if (c2 == 'p') id = RegisterID::rbp;
+					else return false;
+					break;
+				case 'c': if (c2 != 'x') return false; id = RegisterID::rcx; break;
+				case 'd':
+					if (c2 == 'x') id = RegisterID::rdx;
+					else if (c2 == 'i') id = RegisterID::rdi;
+					else return false;
+					break;
+				case 's':
+					if (c2 == 'i') id = RegisterID::rsi;
+					else if (c2 == 'p') id = RegisterID::rsp;
+					else return false;
+					break;
+				case '8': id = RegisterID::r8; length = 2; break;
+				case '9': id = RegisterID::r9; length = 2; break;
+				case '1':
+					switch (c2) {
+						case '0': id = RegisterID::r10; break;
+						case '1': id = RegisterID::r11; break;
+						case '2': id = RegisterID::r12; break;
+						case '3': id = RegisterID::r13; break;
+						case '4': id = RegisterID::r14; break;
+						case '5': id = RegisterID::r15; break;
+						default: return false;
+					}
+					break;
+				default:
+					return false;
+			}
+			this->cursor += length;
+			return true;
+		}
+
+		[[noreturn]] void error(const std::string &message) const {
+			size_t line = 1;
+			size_t column = 1;
+			for (const char *c = this->begin; c < this->cursor; c++) {
+				if (*c == '\n') {
+					line++;
+					column = 1;
+				} else {
+					column++;
+				}
+			}
+			throw std::runtime_error(
+				std::string(this->fileName) + ":" + std::to_string(line) + ":" + std::to_string(column) + ": " + message
+			);
+		}
+
+		private:
+
+		const char *begin;
+		const char *cursor;
+		const char *end;
+		const char *fileName;
+	};
+
+	// the text of one function, from its '(' to just past its ')'
+	struct FunctionBounds {
+		const char *begin;
+		const char *end;
+	};
+
+	/*
+	 * Parser.
+	 * Items are allocated in `arena` and names are interned in `symbols`,
+	 * which need not be the ones of the Program being built.
+	 */
+	class HandwrittenParser {
+		public:
+
+		HandwrittenParser(Lexer &lex, Arena &arena, SymbolTable &symbols) :
+			lex {lex},
+			arena {arena},
+			symbols {symbols},
+			prescanned {nullptr},
+			next_prescanned {0},
+			on_entry_point {nullptr},
+			on_function {nullptr}
+		{}
+
+		// "entry_point_rule"
+		void parse(Program &program) {
+			this->seps_with_comments();
+			this->lex.skip_spaces();
+			this->expect('(');
+			this->seps_with_comments();
+			if (!this->function_name(program.entryPointLabel)) {
+				this->lex.error("expected the entry point name");
+			}
+			if (this->on_entry_point) {
+				(*this->on_entry_point)(program.entryPointLabel, this->symbols);
+			}
+			this->seps_with_comments();
+			this->functions(program.functions);
+			this->seps_with_comments();
+			this->lex.skip_spaces();
+			this->expect(')');
+			this->seps();
+		}
+
+		/*
+		 * Makes parse() step over the given functions instead of parsing them,
+		 * checking only that each one starts where expected.
+		 */
+		void skip_functions(const std::vector<FunctionBounds> &bounds) {
+			this->prescanned = &bounds;
+			this->next_prescanned = 0;
+		}
+
+		// whether parse() stepped over every function given to skip_functions
+		bool skipped_all_functions() const {
+			return this->prescanned && this->next_prescanned == this->prescanned->size();
+		}
+
+		/*
+		 * Makes parse() hand each function to on_function as soon as it is
+		 * parsed instead of adding it to the Program. Each function gets an
+		 * arena of its own, released when on_function returns.
+		 */
+		void stream_functions(const EntryPointCallback &on_entry_point, const FunctionCallback &on_function) {
+			this->on_entry_point = &on_entry_point;
+			this->on_function = &on_function;
+		}
+
+		// "Function_rule"; returns nullptr without consuming input if there is no '('
+		Function *function() {
+			const char *start = this->lex.position();
+			this->lex.skip_spaces();
+			if (!this->lex.character('(')) {
+				this->lex.rewind(start);
+				return nullptr;
+			}
+			this->seps_with_comments();
+
+			this->lex.skip_spaces();
+			Function *f = this->arena.make<Function>();
+			if (!this->function_name(f->name)) {
+				this->lex.error("expected a function name");
+			}
+			this->seps_with_comments();
+
+			this->lex.skip_spaces();
+			if (!this->lex.number(f->num_arguments)) {
+				this->lex.error("expected the number of arguments");
+			}
+			this->seps_with_comments();
+
+			this->lex.skip_spaces();
+			if (!this->lex.number(f->num_locals)) {
+				this->lex.error("expected the number of locals");
+			}
+			this->seps_with_comments();
+
+			this->instructions(f);
+			this->seps_with_comments();
+			this->lex.skip_spaces();
+			this->expect(')');
+			return f;
+		}
+
+		private:
+
+		Lexer &lex;
+		Arena &arena;
+		SymbolTable &symbols;
+		const std::vector<FunctionBounds> *prescanned;
+		size_t next_prescanned;
+		const EntryPointCallback *on_entry_point;
+		const FunctionCallback *on_function;
+
+		void expect(char c) {
+			if (!this->lex.character(c)) {
+				this->lex.error(std::string("expected '") + c + "'");
+			}
+		}
+
+		/*
+		 * Separators.
+		 */
+		void seps() {
+			for (;;) {
+				const char *start = this->lex.position();
+				this->lex.skip_spaces();
+				if (!this->lex.eol()) {
+					this->lex.rewind(start);
+					return;
+				}
+			}
+		}
+
+		void seps_with_comments() {
+			for (;;) {
+				const char *start = this->lex.position();
+				this->lex.skip_spaces();
+				if (!this->lex.eol() && !this->lex.comment()) {
+					this->lex.rewind(start);
+					return;
+				}
+			}
+		}
+
+		/*
+		 * Functions.
+		 */
+
+		// "Functions_rule"
+		void functions(std::vector<Function *> &functions) {
+			bool any = false;
+			for (;;) {
+				const char *start = this->lex.position();
+				this->seps_with_comments();
+				bool found;
+				if (this->prescanned) {
+					found = this->skip_function();
+				} else if (this->on_function) {
+					found = this->stream_function();
+				} else {
+					found = this->add_function(functions);
+				}
+				if (!found) {
+					this->lex.rewind(start);
+					break;
+				}
+				this->seps_with_comments();
+				any = true;
+			}
+			if (!any) {
+				this->lex.error("expected a function");
+			}
+		}
+
+		bool add_function(std::vector<Function *> &functions) {
+			Function *f = this->function();
+			if (!f) {
+				return false;
+			}
+			functions.push_back(f);
+			return true;
+		}
+
+		bool stream_function() {
+			Arena function_arena;
+			HandwrittenParser parser(this->lex, function_arena, this->symbols);
+			Function *f = parser.function();
+			if (!f) {
+				return false;
+			}
+			(*this->on_function)(*f, this->symbols);
+			return true;
+		}
+
+		// steps over the next prescanned function if it starts here
+		bool skip_function() {
+			const char *start = this->lex.position();
+			this->lex.skip_spaces();
+			if (!this->lex.peek('(')) {
+				this->lex.rewind(start);
+				return false;
+			}
+			if (this->next_prescanned == this->prescanned->size() ||
+				(*this->prescanned)[this->next_prescanned].begin != this->lex.position()) {
+				this->lex.error("function boundaries don't match the prescan");
+			}
+			this->lex.rewind((*this->prescanned)[this->next_prescanned].end);
+			this->next_prescanned++;
+			return true;
+		}
+
+		// "Instructions_rule"
+		void instructions(Function *f) {
+			bool any = false;
+			for (;;) {
+				const char *start = this->lex.position();
+				this->seps();
+				if (!this->lex.at_bol()) {
+					this->lex.rewind(start);
+					break;
+				}
+				this->lex.skip_spaces();
+				Instruction *i = this->instruction();
+				if (!i) {
+					this->lex.rewind(start);
+					break;
+				}
+				f->instructions.push_back(i);
+				this->seps();
+				any = true;
+			}
+			if (!any) {
+				this->lex.error("expected an instruction");
+			}
+		}
+
+		/*
+		 * Tokens.
+		 */
+		bool label(SymbolID &symbol) {
+			const char *start = this->lex.position();
+			std::string_view name;
+			if (!this->lex.character(':') || !this->lex.name(name)) {
+				this->lex.rewind(start);
+				return false;
+			}
+			symbol = this->symbols.intern(name);
+			return true;
+		}
+
+		bool function_name(SymbolID &symbol) {
+			const char *start = this->lex.position();
+			std::string_view name;
+			if (!this->lex.character('@') || !this->lex.name(name)) {
+				this->lex.rewind(start);
+				return false;
+			}
+			symbol = this->symbols.intern(name);
+			return true;
+		}
+
+		// "x" in the grammar
+		bool register_any(Operand &operand) {
+			RegisterID id;
+			if (!this->lex.register_name(id)) {
+				return false;
+			}
+			operand = Operand::make_register(id);
+			return true;
+		}
+
+		// "w" in the grammar
+		bool register_writable(Operand &operand) {
+			const char *start = this->lex.position();
+			if (!this->register_any(operand)) {
+				return false;
+			}
+			if (operand.reg == RegisterID::rsp) {
+				this->lex.rewind(start);
+				return false;
+			}
+			return true;
+		}
+
+		// "sx" in the grammar
+		bool register_shift(Operand &operand) {
+			const char *start = this->lex.position();
+			if (!this->register_any(operand)) {
+				return false;
+			}
+			if (operand.reg != RegisterID::rcx) {
+				this->lex.rewind(start);
+				return false;
+			}
+			return true;
+		}
+
+		bool number(Operand &operand) {
+			int64_t value;
+			if (!this->lex.number(value)) {
+				return false;
+			}
+			operand = Operand::make_number(value);
+			return true;
+		}
+
+		// a number whose first digit is one of `digits` ("F" and "E" in the grammar)
+		bool number_starting_with(const char *digits, int64_t &value) {
+			if (this->lex.at_end() || !std::strchr(digits, *this->lex.position())) {
+				return false;
+			}
+			return this->lex.number(value);
+		}
+
+		// "t" in the grammar
+		bool arithmetic_value(Operand &operand) {
+			return this->register_any(operand) || this->number(operand);
+		}
+
+		// "s" in the grammar
+		bool source_value(Operand &operand) {
+			if (this->arithmetic_value(operand)) {
+				return true;
+			}
+			SymbolID symbol;
+			if (this->label(symbol)) {
+				operand = Operand::make_label(symbol);
+				return true;
+			}
+			if (this->function_name(symbol)) {
+				operand = Operand::make_function_name(symbol);
+				return true;
+			}
+			return false;
+		}
+
+		// "mem x M"
+		bool memory_location(Operand &operand) {
+			const char *start = this->lex.position();
+			Operand base;
+			int64_t offset;
+			if (!this->lex.literal("mem")) {
+				return false;
+			}
+			this->lex.skip_spaces();
+			if (!this->register_any(base)) {
+				this->lex.rewind(start);
+				return false;
+			}
+			this->lex.skip_spaces();
+			if (!this->lex.number(offset)) {
+				this->lex.rewind(start);
+				return false;
+			}
+			operand = Operand::make_memory(base.reg, offset);
+			return true;
+		}
+
+		bool comparison_operator(Operator &op) {
+			if (this->lex.literal("<=")) {
+				op = Operator::le;
+			} else if (this->lex.literal("<")) {
+				op = Operator::lt;
+			} else if (this->lex.literal("=")) {
+				op = Operator::eq;
+			} else {
+				return false;
+			}
+			return true;
+		}
+
+		/*
+		 * Instructions.
+		 * Dispatch on the leading token exactly like Instruction_rule.
+		 * Returns nullptr, without consuming input, if no instruction matches.
+		 */
+		Instruction *instruction() {
+			const char *start = this->lex.position();
+			Instruction *i = nullptr;
+			if (this->lex.literal("return")) {
+				i = this->arena.make<Instruction_ret>();
+			} else if (this->lex.literal("goto")) {
+				i = this->instruction_goto();
+			} else if (this->lex.literal("cjump")) {
+				i = this->instruction_cjump();
+			} else if (this->lex.literal("call")) {
+				i = this->instruction_call();
+			} else if (this->lex.peek(':')) {
+				i = this->instruction_label();
+			} else if (this->lex.peek('m')) {
+				i = this->instruction_memory();
+			} else {
+				i = this->instruction_register();
+			}
+			if (!i) {
+				this->lex.rewind(start);
+			}
+			return i;
+		}
+
+		Instruction *instruction_goto() {
+			auto i = this->arena.make<Instruction_goto>();
+			SymbolID symbol;
+			this->lex.skip_spaces();
+			if (!this->label(symbol)) {
+				return nullptr;
+			}
+			i->label = Operand::make_label(symbol);
+			return i;
+		}
+
+		Instruction *instruction_cjump() {
+			auto i = this->arena.make<Instruction_cjump>();
+			SymbolID symbol;
+			this->lex.skip_spaces();
+			if (!this->arithmetic_value(i->lhs)) {
+				return nullptr;
+			}
+			this->lex.skip_spaces();
+			if (!this->comparison_operator(i->op)) {
+				return nullptr;
+			}
+			this->lex.skip_spaces();
+			if (!this->arithmetic_value(i->rhs)) {
+				return nullptr;
+			}
+			this->lex.skip_spaces();
+			if (!this->label(symbol)) {
+				return nullptr;
+			}
+			i->label = Operand::make_label(symbol);
+			return i;
+		}
+
+		Instruction *instruction_label() {
+			auto i = this->arena.make<Instruction_label>();
+			SymbolID symbol;
+			if (!this->label(symbol)) {
+				return nullptr;
+			}
+			i->label = Operand::make_label(symbol);
+			return i;
+		}
+
+		Instruction *call_runtime(RuntimeFunction function, int64_t num_arguments) {
+			auto i = this->arena.make<Instruction_call_runtime>();
+			i->function = function;
+			i->num_arguments = num_arguments;
+			return i;
+		}
+
+		// everything after "call"
+		Instruction *instruction_call() {
+			this->lex.skip_spaces();
+			const char *start = this->lex.position();
+
+			if (this->lex.literal("print")) {
+				this->lex.skip_spaces();
+				if (this->lex.character('1')) {
+					return this->call_runtime(RuntimeFunction::print, 1);
+				}
+				this->lex.rewind(start);
+			}
+			if (this->lex.literal("input")) {
+				this->lex.skip_spaces();
+				if (this->lex.character('0')) {
+					return this->call_runtime(RuntimeFunction::input, 0);
+				}
+				this->lex.rewind(start);
+			}
+			if (this->lex.literal("allocate")) {
+				this->lex.skip_spaces();
+				if (this->lex.character('2')) {
+					return this->call_runtime(RuntimeFunction::allocate, 2);
+				}
+				this->lex.rewind(start);
+			}
+			if (this->lex.literal("tuple-error")) {
+				this->lex.skip_spaces();
+				if (this->lex.character('3')) {
+					return this->call_runtime(RuntimeFunction::tuple_error, 3);
+				}
+				this->lex.rewind(start);
+			}
+			if (this->lex.literal("tensor-error")) {
+				int64_t num_arguments;
+				this->lex.skip_spaces();
+				if (this->number_starting_with("134", num_arguments)) {
+					return this->call_runtime(RuntimeFunction::tensor_error, num_arguments);
+				}
+				this->lex.rewind(start);
+			}
+
+			// "call u N"
+			auto i = this->arena.make<Instruction_call>();
+			SymbolID symbol;
+			if (this->function_name(symbol)) {
+				i->callee = Operand::make_function_name(symbol);
+			} else if (!this->register_writable(i->callee)) {
+				return nullptr;
+			}
+			this->lex.skip_spaces();
+			if (!this->lex.number(i->num_arguments)) {
+				return nullptr;
+			}
+			return i;
+		}
+
+		// "mem x M <- s", "mem x M += t", and "mem x M -= t"
+		Instruction *instruction_memory() {
+			Operand destination;
+			if (!this->memory_location(destination)) {
+				return nullptr;
+			}
+			this->lex.skip_spaces();
+			if (this->lex.literal("<-")) {
+				auto i = this->arena.make<Instruction_assignment>();
+				i->destination = destination;
+				this->lex.skip_spaces();
+				if (!this->source_value(i->source)) {
+					return nullptr;
+				}
+				return i;
+			}
+			Operator op;
+			if (this->lex.literal("+=")) {
+				op = Operator::plus;
+			} else if (this->lex.literal("-=")) {
+				op = Operator::minus;
+			} else {
+				return nullptr;
+			}
+			auto i = this->arena.make<Instruction_arithmetic>();
+			i->op = op;
+			i->destination = destination;
+			this->lex.skip_spaces();
+			if (!this->arithmetic_value(i->source)) {
+				return nullptr;
+			}
+			return i;
+		}
+
+		// every instruction starting with "w"
+		Instruction *instruction_register() {
+			Operand destination;
+			if (!this->register_writable(destination)) {
+				return nullptr;
+			}
+			this->lex.skip_spaces();
+
+			if (this->lex.literal("<-")) {
+				return this->register_assignment(destination);
+			}
+
+			// "w aop t", "w += mem x M", and "w -= mem x M"
+			if (this->lex.literal("+=")) {
+				return this->register_arithmetic(destination, Operator::plus, true);
+			}
+			if (this->lex.literal("-=")) {
+				return this->register_arithmetic(destination, Operator::minus, true);
+			}
+			if (this->lex.literal("*=")) {
+				return this->register_arithmetic(destination, Operator::times, false);
+			}
+			if (this->lex.literal("&=")) {
+				return this->register_arithmetic(destination, Operator::bitwise_and, false);
+			}
+
+			// "w sop sx" and "w sop N"
+			Operator shift;
+			bool is_shift = false;
+			if (this->lex.literal("<<=")) {
+				shift = Operator::lshift;
+				is_shift = true;
+			} else if (this->lex.literal(">>=")) {
+				shift = Operator::rshift;
+				is_shift = true;
+			}
+			if (is_shift) {
+				auto i = this->arena.make<Instruction_shift>();
+				i->op = shift;
+				i->destination = destination;
+				this->lex.skip_spaces();
+				if (!this->register_shift(i->source) && !this->number(i->source)) {
+					return nullptr;
+				}
+				return i;
+			}
+
+			if (this->lex.literal("++")) {
+				auto i = this->arena.make<Instruction_increment>();
+				i->destination = destination;
+				return i;
+			}
+			if (this->lex.literal("--")) {
+				auto i = this->arena.make<Instruction_decrement>();
+				i->destination = destination;
+				return i;
+			}
+
+			// "w @ w w E"
+			if (this->lex.character('@')) {
+				auto i = this->arena.make<Instruction_lea>();
+				i->destination = destination;
+				this->lex.skip_spaces();
+				if (!this->register_writable(i->base)) {
+					return nullptr;
+				}
+				this->lex.skip_spaces();
+				if (!this->register_writable(i->index)) {
+					return nullptr;
+				}
+				this->lex.skip_spaces();
+				if (!this->number_starting_with("1248", i->scale)) {
+					return nullptr;
+				}
+				return i;
+			}
+
+			return nullptr;
+		}
+
+		// "w <- s", "w <- mem x M", and "w <- t cmp t", after the arrow
+		Instruction *register_assignment(Operand destination) {
+			Operand source;
+			this->lex.skip_spaces();
+			if (this->arithmetic_value(source)) {
+				// " cmp t" turns it into a comparison
+				const char *start = this->lex.position();
+				Operator op;
+				Operand rhs;
+				this->lex.skip_spaces();
+				if (this->comparison_operator(op)) {
+					this->lex.skip_spaces();
+					if (this->arithmetic_value(rhs)) {
+						auto i = this->arena.make<Instruction_compare_assignment>();
+						i->op = op;
+						i->lhs = source;
+						i->rhs = rhs;
+						i->destination = destination;
+						return i;
+					}
+				}
+				this->lex.rewind(start);
+			} else if (!this->memory_location(source) && !this->source_value(source)) {
+				return nullptr;
+			}
+
+			auto i = this->arena.make<Instruction_assignment>();
+			i->source = source;
+			i->destination = destination;
+			return i;
+		}
+
+		Instruction *register_arithmetic(Operand destination, Operator op, bool allow_memory) {
+			auto i = this->arena.make<Instruction_arithmetic>();
+			i->op = op;
+			i->destination = destination;
+			this->lex.skip_spaces();
+			if (!(allow_memory && this->memory_location(i->source)) && !this->arithmetic_value(i->source)) {
+				return nullptr;
+			}
+			return i;
+		}
+	};
+
+	Program parse_file_handwritten(char *fileName) {
+		MappedFile file(fileName);
+		Lexer lex(file.data, file.data + file.size, fileName);
+		Program p;
+		HandwrittenParser parser(lex, p.arena, p.symbols);
+		parser.parse(p);
+		return p;
+	}
+
+	void parse_file_streaming_handwritten(
+		char *fileName,
+		SymbolTable &symbols,
+		const EntryPointCallback &on_entry_point,
+		const FunctionCallback &on_function
+	) {
+		MappedFile file(fileName);
+		Lexer lex(file.data, file.data + file.size, fileName);
+
+		// the input already consumed isn't needed anymore either
+		FunctionCallback release_input = [&](Function &f, const SymbolTable &symbols) {
+			on_function(f, symbols);
+			file.release_before(lex.position());
+		};
+
+		// only the entry point ends up in here
+		Program p;
+		HandwrittenParser parser(lex, p.arena, symbols);
+		parser.stream_functions(on_entry_point, release_input);
+		parser.parse(p);
+	}
+
+	/*
+	 * Parallel parsing.
+	 * A prescan finds the text of every function by balancing parentheses,
+	 * skipping comments. The parser then checks the rest of the file with
+	 * skip_functions, while a pool of workers parses the functions
+	 * themselves, each worker into its own arena and each function against
+	 * its own symbol table. The functions are then moved into the Program in
+	 * source order, re-interning their names in that order, so the result is
+	 * the same Program the sequential parser builds.
+	 *
+	 * Each piece is parsed by the same code, starting at the same position,
+	 * as in a sequential parse, so whenever the parallel parse succeeds the
+	 * sequential one would as well. If anything fails, the file is parsed
+	 * again sequentially to report the error.
+	 */
+
+	// returns false if the parentheses don't balance
+	static bool prescan_functions(const char *begin, const char *end, std::vector<FunctionBounds> &bounds) {
+		size_t depth = 0;
+		const char *function_begin = nullptr;
+		for (const char *c = begin; c != end; c++) {
+			switch (*c) {
+				case '/':
+					if (c + 1 != end && c[1] == '/') {
+						c = static_cast<const char *>(std::memchr(c, '\n', end - c));
+						if (!c) {
+							return false;
+						}
+					}
+					break;
+				case '(':
+					depth++;
+					if (depth == 2) {
+						function_begin = c;
+					}
+					break;
+				case ')':
+					if (depth == 0) {
+						return false;
+					}
+					if (depth == 2) {
+						bounds.push_back({function_begin, c + 1});
+					}
+					depth--;
+					if (depth == 0) {
+						// anything after the program is ignored, as in a sequential parse
+						return true;
+					}
+					break;
+			}
+		}
+		return false;
+	}
+
+	// what a worker produced for one function
+	struct ParsedFunction {
+		SymbolTable symbols;
+		Function *function = nullptr;
+	};
+
+	Program parse_file_parallel(char *fileName, unsigned num_threads) {
+		MappedFile file(fileName);
+		const char *end = file.data + file.size;
+
+		std::vector<FunctionBounds> bounds;
+		if (!prescan_functions(file.data, end, bounds) || bounds.empty()) {
+			return parse_file_handwritten(fileName);
+		}
+
+		/*
+		 * Everything outside the functions.
+		 */
+		Program p;
+		try {
+			Lexer lex(file.data, end, fileName);
+			HandwrittenParser parser(lex, p.arena, p.symbols);
+			parser.skip_functions(bounds);
+			parser.parse(p);
+			if (!parser.skipped_all_functions()) {
+				return parse_file_handwritten(fileName);
+			}
+		} catch (const std::runtime_error &) {
+			return parse_file_handwritten(fileName);
+		}
+
+		/*
+		 * The functions.
+		 */
+		if (num_threads == 0) {
+			num_threads = std::max(1u, std::thread::hardware_concurrency());
+		}
+		num_threads = std::min<size_t>(num_threads, bounds.size());
+
+		std::vector<ParsedFunction> parsed(bounds.size());
+		std::vector<Arena> arenas(num_threads);
+		std::atomic<size_t> next_function {0};
+		std::atomic<bool> failed {false};
+		auto work = [&](Arena &arena) {
+			for (size_t k = next_function++; k < bounds.size() && !failed; k = next_function++) {
+				try {
+					Lexer lex(file.data, end, fileName);
+					lex.rewind(bounds[k].begin);
+					HandwrittenParser parser(lex, arena, parsed[k].symbols);
+					parsed[k].function = parser.function();
+					if (!parsed[k].function || lex.position() != bounds[k].end) {
+						failed = true;
+					}
+				} catch (const std::runtime_error &) {
+					failed = true;
+				}
+			}
+		};
+		std::vector<std::thread> workers;
+		for (unsigned t = 1; t < num_threads; t++) {
+			workers.emplace_back(work, std::ref(arenas[t]));
+		}
+		work(arenas[0]);
+		for (auto &worker : workers) {
+			worker.join();
+		}
+		if (failed) {
+			return parse_file_handwritten(fileName);
+		}
+
+		/*
+		 * Merge in source order.
+		 */
+		std::vector<SymbolID> new_ids;
+		for (auto &pf : parsed) {
+			new_ids.clear();
+			for (SymbolID id = 0; id < pf.symbols.size(); id++) {
+				new_ids.push_back(p.symbols.intern(pf.symbols.name(id)));
+			}
+			pf.function->remap_symbols(new_ids);
+			p.functions.push_back(pf.function);
+		}
+		for (auto &arena : arenas) {
+			p.arena.adopt(std::move(arena));
+		}
+		return p;
+	}
+}
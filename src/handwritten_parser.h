@@ -0,0 +1,27 @@
+#pragma once
+
+#include <L1.h>
+#include <parser.h>
+
+namespace L1 {
+	/*
+	 * Hand-written alternative to the PEGTL parser in parser.cpp.
+	 * It accepts the same language and builds an identical Program; use it
+	 * through parse_file with ParserKind::handwritten.
+	 */
+	Program parse_file_handwritten(char *fileName);
+
+	/*
+	 * The hand-written parser with the functions parsed concurrently on
+	 * `num_threads` threads (0 means one per core). Builds the same Program.
+	 */
+	Program parse_file_parallel(char *fileName, unsigned num_threads);
+
+	// the implementation of parse_file_streaming
+	void parse_file_streaming_handwritten(
+		char *fileName,
+		SymbolTable &symbols,
+		const EntryPointCallback &on_entry_point,
+		const FunctionCallback &on_function
+	);
+}
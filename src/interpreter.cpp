@@ -10,15 +10,20 @@
 #include <cstdlib>
 #include <stdint.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <iostream>
+#include <stdexcept>
 
 #include <parser.h>
 #include <code_generator.h>
+#include <jit.h>
+#include <bytecode_interpreter.h>
 
 using namespace std;
 
 void print_help(char *progName) {
-	std::cerr << "Usage: " << progName << " SOURCE" << std::endl;
+	std::cerr << "Usage: " << progName << " [-p pegtl|handwritten|parallel] [-e jit|bytecode] [--no-fusion] [--profile-pairs] SOURCE" << std::endl;
+	std::cerr << "  --no-fusion: run the bytecode without superinstructions" << std::endl;
 	return;
 }
 
@@ -26,9 +31,10 @@ int main(
 	int argc,
 	char **argv
 ) {
-	auto enable_code_generator = false;
-	int32_t optLevel = 0;
-	bool verbose;
+	L1::ParserKind parser = L1::ParserKind::pegtl;
+	bool use_jit = true;
+	bool profile_pairs = false;
+	bool fuse = true;
 
 	/*
 	 * Check the compiler arguments.
@@ -37,16 +43,76 @@ int main(
 		print_help(argv[0]);
 		return 1;
 	}
+	static const struct option long_options[] = {
+		{"profile-pairs", no_argument, nullptr, 'P'},
+		{"no-fusion", no_argument, nullptr, 'F'},
+		{nullptr, 0, nullptr, 0}
+	};
+	int32_t opt;
+	while ((opt = getopt_long(argc, argv, "p:e:", long_options, nullptr)) != -1) {
+		switch (opt) {
+			case 'p':
+				if (!L1::parser_kind_from_string(optarg, parser)) {
+					print_help(argv[0]);
+					return 1;
+				}
+				break;
+			case 'e':
+				if (strcmp(optarg, "jit") == 0) {
+					use_jit = true;
+				} else if (strcmp(optarg, "bytecode") == 0) {
+					use_jit = false;
+				} else {
+					print_help(argv[0]);
+					return 1;
+				}
+				break;
+			case 'P':
+				profile_pairs = true;
+				break;
+			case 'F':
+				fuse = false;
+				break;
+			default:
+				print_help(argv[0]);
+				return 1;
+		}
+	}
 
 	/*
 	 * Parse the input file.
 	 */
-	auto p = L1::parse_file(argv[optind]);
+	L1::Program p;
+	try {
+		p = L1::parse_file(argv[optind], parser);
+	} catch (const std::runtime_error &e) {
+		// tao::pegtl::parse_error is a std::runtime_error too
+		std::cerr << "L1i: " << e.what() << std::endl;
+		return 1;
+	}
 
 	/*
-	 * Interpret the L1 program.
+	 * Run the L1 program: either compile it to machine code in memory and
+	 * jump to its entry point, or interpret it as bytecode.
+	 * Profiling runs the bytecode without superinstructions, to show which
+	 * pairs are worth fusing.
 	 */
-	//TODO
+	try {
+		if (profile_pairs) {
+			L1::BytecodeProgram program(p, false);
+			program.profile_pairs(std::cerr);
+		} else if (use_jit) {
+			L1::JitProgram program(p);
+			program.run();
+		} else {
+			L1::BytecodeProgram program(p, fuse);
+			program.run();
+		}
+	} catch (const std::runtime_error &e) {
+		// labels that are never defined, or memory the code can't run from
+		std::cerr << "L1i: " << e.what() << std::endl;
+		return 1;
+	}
 
 	return 0;
 }
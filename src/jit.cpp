@@ -0,0 +1,77 @@
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <vector>
+#include <stdexcept>
+#include <sys/mman.h>
+
+#include <jit.h>
+#include <machine_code.h>
+#include <runtime.h>
+
+namespace L1 {
+	JitProgram::JitProgram(const Program &p) : memory {nullptr}, size {0} {
+		MachineCodeBuilder builder;
+		builder.begin(p.entryPointLabel);
+		for (const Function *f : p.functions) {
+			builder.add_function(*f, p.symbols);
+		}
+		builder.resolve_labels(p.symbols);
+		std::vector<uint8_t> &code = builder.encoder.code;
+
+		/*
+		 * The runtime is too far away for a rel32, so every runtime call goes
+		 * through a trampoline after the code, "jmp *0(%rip)" followed by the
+		 * absolute address. There is one trampoline per runtime function.
+		 */
+		std::vector<std::pair<void *, std::size_t>> trampolines;
+		for (const auto &call : builder.runtime_calls) {
+			void *target = runtime_function_address(call.function, call.num_arguments);
+			auto t = std::find_if(trampolines.begin(), trampolines.end(), [target](const auto &t) { return t.first == target; });
+			if (t == trampolines.end()) {
+				trampolines.push_back({target, code.size()});
+				t = trampolines.end() - 1;
+				const uint8_t jump[] = {0xff, 0x25, 0, 0, 0, 0};
+				code.insert(code.end(), jump, jump + sizeof(jump));
+				uint64_t address = reinterpret_cast<uint64_t>(target);
+				for (int i = 0; i < 8; i++) {
+					code.push_back(address >> (8 * i));
+				}
+			}
+			builder.encoder.patch_rel32(call.offset, t->second);
+		}
+
+		/*
+		 * Label addresses stored to memory are sign-extended 32-bit
+		 * immediates, so the code has to live in the low 2 GiB.
+		 */
+		this->size = code.size();
+		this->memory = mmap(nullptr, this->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+		if (this->memory == MAP_FAILED) {
+			this->memory = nullptr;
+			throw std::runtime_error("unable to map memory for the code");
+		}
+		uint64_t base = reinterpret_cast<uint64_t>(this->memory);
+		for (const auto &r : builder.label_references) {
+			if (r.kind == MachineCodeBuilder::ReferenceKind::abs32) {
+				builder.encoder.patch32(r.offset, static_cast<int32_t>(base + builder.symbol_offsets[r.target]));
+			}
+		}
+		std::memcpy(this->memory, code.data(), this->size);
+		if (mprotect(this->memory, this->size, PROT_READ | PROT_EXEC) != 0) {
+			throw std::runtime_error("unable to make the code executable");
+		}
+	}
+
+	JitProgram::~JitProgram() {
+		if (this->memory) {
+			munmap(this->memory, this->size);
+		}
+	}
+
+	void JitProgram::run() {
+		// "go" is at the start of the code
+		auto go = reinterpret_cast<void (*)()>(this->memory);
+		go();
+	}
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+
+#include <L1.h>
+
+namespace L1 {
+	/*
+	 * A program compiled to machine code in executable memory.
+	 * The code is the same the object generator writes; labels and calls
+	 * are resolved in memory and runtime calls go to runtime.h.
+	 */
+	class JitProgram {
+		public:
+
+		JitProgram(const Program &p);
+		JitProgram(const JitProgram &) = delete;
+		JitProgram &operator=(const JitProgram &) = delete;
+		~JitProgram();
+
+		// calls the entry point
+		void run();
+
+		private:
+
+		void *memory;
+		std::size_t size;
+	};
+}
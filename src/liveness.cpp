@@ -0,0 +1,132 @@
+#include <utility>
+
+#include <liveness.h>
+
+namespace L1 {
+	static const RegisterID argument_registers[] = {
+		RegisterID::rdi, RegisterID::rsi, RegisterID::rdx, RegisterID::rcx, RegisterID::r8, RegisterID::r9
+	};
+
+	static RegisterSet arguments(int64_t num_arguments) {
+		RegisterSet s = 0;
+		for (int64_t a = 0; a < num_arguments && a < 6; a++) {
+			s |= register_set(argument_registers[a]);
+		}
+		return s;
+	}
+
+	// registers and memory bases are read
+	static RegisterSet reads(const Operand &o) {
+		return o.kind == OperandKind::reg || o.kind == OperandKind::memory ? register_set(o.reg) : 0;
+	}
+
+	static RegisterSet writes(const Operand &o) {
+		return o.kind == OperandKind::reg ? register_set(o.reg) : 0;
+	}
+
+	// one virtual call per instruction; analyses run this on every instruction of large functions
+	struct EffectsVisitor : InstructionVisitor {
+		RegisterEffects effects = {0, 0};
+
+		virtual void visit(Instruction_ret &i) override {
+			this->effects = {static_cast<RegisterSet>(register_set(RegisterID::rax) | callee_saved), 0};
+		}
+
+		virtual void visit(Instruction_assignment &i) override {
+			RegisterSet base = i.destination.kind == OperandKind::memory ? reads(i.destination) : 0;
+			this->effects = {static_cast<RegisterSet>(reads(i.source) | base), writes(i.destination)};
+		}
+
+		virtual void visit(Instruction_arithmetic &i) override {
+			this->effects = {static_cast<RegisterSet>(reads(i.source) | reads(i.destination)), writes(i.destination)};
+		}
+
+		virtual void visit(Instruction_shift &i) override {
+			this->effects = {static_cast<RegisterSet>(reads(i.source) | reads(i.destination)), writes(i.destination)};
+		}
+
+		virtual void visit(Instruction_compare_assignment &i) override {
+			this->effects = {static_cast<RegisterSet>(reads(i.lhs) | reads(i.rhs)), writes(i.destination)};
+		}
+
+		virtual void visit(Instruction_cjump &i) override {
+			this->effects = {static_cast<RegisterSet>(reads(i.lhs) | reads(i.rhs)), 0};
+		}
+
+		virtual void visit(Instruction_label &i) override {}
+
+		virtual void visit(Instruction_goto &i) override {}
+
+		virtual void visit(Instruction_call &i) override {
+			this->effects = {static_cast<RegisterSet>(reads(i.callee) | arguments(i.num_arguments) | register_set(RegisterID::rsp)), caller_saved};
+		}
+
+		virtual void visit(Instruction_call_runtime &i) override {
+			this->effects = {static_cast<RegisterSet>(arguments(i.num_arguments) | register_set(RegisterID::rsp)), caller_saved};
+		}
+
+		virtual void visit(Instruction_increment &i) override {
+			this->effects = {reads(i.destination), writes(i.destination)};
+		}
+
+		virtual void visit(Instruction_decrement &i) override {
+			this->effects = {reads(i.destination), writes(i.destination)};
+		}
+
+		virtual void visit(Instruction_lea &i) override {
+			this->effects = {static_cast<RegisterSet>(reads(i.base) | reads(i.index)), writes(i.destination)};
+		}
+	};
+
+	RegisterEffects register_effects(Instruction *i) {
+		EffectsVisitor visitor;
+		i->accept(visitor);
+		return visitor.effects;
+	}
+
+	/*
+	 * Liveness as a backward problem, with each block summarized as the
+	 * registers it reads before writing them and the ones it writes.
+	 */
+	struct LivenessProblem {
+		using Set = RegisterSet;
+
+		Direction direction = Direction::backward;
+		std::vector<RegisterEffects> summaries;
+
+		Set initial() const {
+			return 0;
+		}
+
+		Set boundary() const {
+			return all_registers;
+		}
+
+		void join(Set &into, Set from) const {
+			into |= from;
+		}
+
+		void transfer(std::size_t b, Set &s) const {
+			s = this->summaries[b].reads | (s & ~this->summaries[b].writes);
+		}
+	};
+
+	// Liveness methods
+
+	Liveness::Liveness(const Function &f, const ControlFlowGraph &cfg) {
+		LivenessProblem problem;
+		problem.summaries.reserve(cfg.blocks.size());
+		for (const BasicBlock &block : cfg.blocks) {
+			RegisterEffects summary = {0, 0};
+			for (std::size_t k = block.end; k-- > block.begin;) {
+				RegisterEffects e = register_effects(f.instructions[k]);
+				summary.reads = e.reads | (summary.reads & ~e.writes);
+				summary.writes |= e.writes;
+			}
+			problem.summaries.push_back(summary);
+		}
+		DataflowSolution<RegisterSet> solution = solve(cfg, problem);
+		this->live_in = std::move(solution.in);
+		this->live_out = std::move(solution.out);
+	}
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <L1.h>
+#include <cfg.h>
+#include <dataflow.h>
+
+namespace L1 {
+	// a set of registers: bit r stands for RegisterID r
+	using RegisterSet = uint16_t;
+
+	inline RegisterSet register_set(RegisterID r) {
+		return static_cast<RegisterSet>(1u << static_cast<unsigned>(r));
+	}
+
+	inline bool contains(RegisterSet s, RegisterID r) {
+		return (s & register_set(r)) != 0;
+	}
+
+	const RegisterSet all_registers = 0xffff;
+
+	// the registers a call leaves as they were; rsp counts, since the callee restores it
+	const RegisterSet callee_saved =
+		register_set(RegisterID::rbx) | register_set(RegisterID::rbp) |
+		register_set(RegisterID::r12) | register_set(RegisterID::r13) |
+		register_set(RegisterID::r14) | register_set(RegisterID::r15) |
+		register_set(RegisterID::rsp);
+
+	// the registers a call may change
+	const RegisterSet caller_saved = all_registers & ~callee_saved;
+
+	/*
+	 * The registers an instruction reads, and the ones it writes.
+	 *
+	 * Calls and returns follow the L1 calling convention: a call reads its
+	 * callee and argument registers and clobbers the other caller-saved
+	 * registers, and a return reads rax and the callee-saved registers.
+	 */
+	struct RegisterEffects {
+		RegisterSet reads;
+		RegisterSet writes;
+	};
+
+	RegisterEffects register_effects(Instruction *i);
+
+	// the registers live before `i`, given the ones live after it
+	inline RegisterSet live_before(Instruction *i, RegisterSet live_after) {
+		RegisterEffects e = register_effects(i);
+		return e.reads | (live_after & ~e.writes);
+	}
+
+	/*
+	 * The registers whose values may still be read, at the start and at the
+	 * end of every block of a function. Leaving the function other than
+	 * by a return may read any register.
+	 */
+	struct Liveness {
+		std::vector<RegisterSet> live_in;
+		std::vector<RegisterSet> live_out;
+
+		Liveness(const Function &f, const ControlFlowGraph &cfg);
+	};
+}
@@ -0,0 +1,355 @@
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include <machine_code.h>
+#include <compare_branch.h>
+#include <block_layout.h>
+
+namespace L1 {
+	using Condition = X86Encoder::Condition;
+	using AluOp = X86Encoder::AluOp;
+	using ShiftOp = X86Encoder::ShiftOp;
+	using Memory = X86Encoder::Memory;
+
+	static const RegisterID callee_saved_registers[] = {
+		RegisterID::rbx, RegisterID::rbp, RegisterID::r12, RegisterID::r13, RegisterID::r14, RegisterID::r15
+	};
+
+	// the condition that holds when `lhs op rhs` does
+	static Condition condition(Operator op) {
+		switch (op) {
+			case Operator::lt: return Condition::l;
+			case Operator::le: return Condition::le;
+			default: return Condition::e;
+		}
+	}
+
+	// the condition that holds when `rhs op lhs` does
+	static Condition swapped_condition(Operator op) {
+		switch (op) {
+			case Operator::lt: return Condition::g;
+			case Operator::le: return Condition::ge;
+			default: return Condition::e;
+		}
+	}
+
+	// the condition that holds when `c` doesn't; x86 pairs them up in the low bit
+	static Condition negated(Condition c) {
+		return static_cast<Condition>(static_cast<uint8_t>(c) ^ 1);
+	}
+
+	static AluOp alu_op(Operator op) {
+		switch (op) {
+			case Operator::plus: return AluOp::add;
+			case Operator::minus: return AluOp::sub;
+			default: return AluOp::bitwise_and;
+		}
+	}
+
+	static Memory memory(shape::Memory m) {
+		return {m.base, immediate(m.offset)};
+	}
+
+	/*
+	 * Instruction selection for the body of one function; the same choices
+	 * as the assembly generator, encoded directly. Jumps to a block that
+	 * doesn't start with an L1 label are resolved once the function is
+	 * encoded.
+	 */
+	class MachineCodeSelector : public BlockSelector {
+		public:
+
+		MachineCodeSelector(MachineCodeBuilder &builder, const Function &f, const SymbolTable &symbols) :
+			builder {builder},
+			encoder {builder.encoder},
+			f {f},
+			symbols {symbols}
+		{}
+
+		virtual void visit(Instruction_ret &i) override {
+			int64_t frame = 8 * (this->f.num_locals + stack_arguments(this->f.num_arguments));
+			if (frame > 0) {
+				this->encoder.alu(AluOp::add, RegisterID::rsp, immediate(frame));
+			}
+			this->encoder.ret();
+		}
+
+		virtual void visit(Instruction_assignment &i) override {
+			i.with_operands([this](auto d, auto s) { this->assign(d, s); });
+		}
+
+		virtual void visit(Instruction_arithmetic &i) override {
+			i.with_operands([this, &i](auto d, auto s) { this->arithmetic(i.op, d, s); });
+		}
+
+		virtual void visit(Instruction_shift &i) override {
+			ShiftOp op = i.op == Operator::lshift ? ShiftOp::shl : ShiftOp::sar;
+			i.with_operands([this, op](auto d, auto s) { this->shift(op, d, s); });
+		}
+
+		virtual void visit(Instruction_compare_assignment &i) override {
+			i.with_operands([this, &i](auto d, auto lhs, auto rhs) {
+				if constexpr (std::is_same_v<decltype(lhs), shape::Number> && std::is_same_v<decltype(rhs), shape::Number>) {
+					this->encoder.mov(d.id, (int64_t)compare_constants(i.op, lhs.value, rhs.value));
+				} else {
+					this->encoder.setcc(this->compare(i.op, lhs, rhs), d.id);
+					this->encoder.movzx8(d.id, d.id);
+				}
+			});
+		}
+
+		virtual void visit(Instruction_cjump &i) override {
+			this->cjump(i, false, {&i.label, 0});
+		}
+
+		virtual void visit(Instruction_label &i) override {
+			this->builder.define(i.label.symbol, this->symbols);
+			this->builder.labels.push_back(i.label.symbol);
+		}
+
+		virtual void visit(Instruction_goto &i) override {
+			this->jump(this->encoder.jmp(), i.label);
+		}
+
+		virtual void visit(Instruction_call &i) override {
+			// the caller already stored the return address at "mem rsp -8"
+			this->encoder.alu(AluOp::sub, RegisterID::rsp, immediate(8 * (stack_arguments(i.num_arguments) + 1)));
+			i.with_operands([this](auto callee) { this->call(callee); });
+		}
+
+		virtual void visit(Instruction_call_runtime &i) override {
+			this->builder.runtime_calls.push_back({this->encoder.call(), i.function, i.num_arguments});
+		}
+
+		virtual void visit(Instruction_increment &i) override {
+			this->encoder.inc(i.destination.reg);
+		}
+
+		virtual void visit(Instruction_decrement &i) override {
+			this->encoder.dec(i.destination.reg);
+		}
+
+		virtual void visit(Instruction_lea &i) override {
+			this->encoder.lea(i.destination.reg, i.base.reg, i.index.reg, i.scale);
+		}
+
+		/*
+		 * A cjump that goes to `target`, when its condition holds or, if
+		 * `negate`, when it doesn't.
+		 */
+		virtual void cjump(const Instruction_cjump &i, bool negate, const JumpTarget &target) override {
+			i.with_operands([this, &i, negate, &target](auto lhs, auto rhs) {
+				if constexpr (std::is_same_v<decltype(lhs), shape::Number> && std::is_same_v<decltype(rhs), shape::Number>) {
+					if (compare_constants(i.op, lhs.value, rhs.value) != negate) {
+						this->jump(this->encoder.jmp(), target);
+					}
+				} else {
+					Condition cc = this->compare(i.op, lhs, rhs);
+					this->jump(this->encoder.jcc(negate ? negated(cc) : cc), target);
+				}
+			});
+		}
+
+		/*
+		 * A compare whose result feeds the cjump after it: one cmp and one
+		 * jcc, to `target`, negated if `negate`.
+		 */
+		virtual void compare_branch(const CompareBranch &branch, bool negate, const JumpTarget &target) override {
+			bool jump_if_true = branch.jump_if_true != negate;
+			branch.compare->with_operands([this, &branch, jump_if_true, &target](auto d, auto lhs, auto rhs) {
+				Operator op = branch.compare->op;
+				if constexpr (std::is_same_v<decltype(lhs), shape::Number> && std::is_same_v<decltype(rhs), shape::Number>) {
+					bool holds = compare_constants(op, lhs.value, rhs.value);
+					if (branch.result_live) {
+						this->encoder.mov(d.id, (int64_t)holds);
+					}
+					if (holds == jump_if_true) {
+						this->jump(this->encoder.jmp(), target);
+					}
+				} else {
+					Condition cc = this->compare(op, lhs, rhs);
+					if (branch.result_live) {
+						// neither setcc nor movzx touch the flags
+						this->encoder.setcc(cc, d.id);
+						this->encoder.movzx8(d.id, d.id);
+					}
+					this->jump(this->encoder.jcc(jump_if_true ? cc : negated(cc)), target);
+				}
+			});
+		}
+
+		virtual void start_block(std::size_t b, bool aligned, bool needs_label) override {
+			if (aligned) {
+				this->encoder.align(16);
+			}
+			this->block_offsets[b] = this->encoder.size();
+		}
+
+		virtual void jump(const JumpTarget &target) override {
+			this->jump(this->encoder.jmp(), target);
+		}
+
+		// where each block starts, once start_block has been called for it
+		std::vector<std::size_t> block_offsets;
+		// the rel32 of every jump to a block without a label, and the block
+		std::vector<std::pair<std::size_t, std::size_t>> block_jumps;
+
+		private:
+
+		MachineCodeBuilder &builder;
+		X86Encoder &encoder;
+		const Function &f;
+		const SymbolTable &symbols;
+
+		void jump(std::size_t offset, const Operand &target) {
+			this->builder.reference(offset, target.symbol, MachineCodeBuilder::ReferenceKind::rel32);
+		}
+
+		void jump(std::size_t offset, const JumpTarget &target) {
+			if (target.label) {
+				this->jump(offset, *target.label);
+			} else {
+				this->block_jumps.push_back({offset, target.block});
+			}
+		}
+
+		/*
+		 * One overload per form of each instruction; with_operands picks the
+		 * overload at compile time from the shapes of the operands.
+		 */
+
+		void assign(shape::w d, shape::x s) { this->encoder.mov(d.id, s.id); }
+		void assign(shape::w d, shape::Number s) { this->encoder.mov(d.id, s.value); }
+		void assign(shape::w d, shape::Memory s) { this->encoder.mov(d.id, memory(s)); }
+		void assign(shape::w d, shape::Label s) {
+			this->builder.reference(this->encoder.lea_rip(d.id), s.symbol, MachineCodeBuilder::ReferenceKind::rel32);
+		}
+		void assign(shape::Memory d, shape::x s) { this->encoder.mov(memory(d), s.id); }
+		void assign(shape::Memory d, shape::Number s) { this->encoder.mov(memory(d), immediate(s.value)); }
+		void assign(shape::Memory d, shape::Label s) {
+			this->builder.reference(this->encoder.mov(memory(d), 0), s.symbol, MachineCodeBuilder::ReferenceKind::abs32);
+		}
+
+		void arithmetic(Operator op, shape::w d, shape::x s) {
+			if (op == Operator::times) {
+				this->encoder.imul(d.id, s.id);
+			} else {
+				this->encoder.alu(alu_op(op), d.id, s.id);
+			}
+		}
+		void arithmetic(Operator op, shape::w d, shape::Number s) {
+			if (op == Operator::times) {
+				this->encoder.imul(d.id, immediate(s.value));
+			} else {
+				this->encoder.alu(alu_op(op), d.id, immediate(s.value));
+			}
+		}
+		void arithmetic(Operator op, shape::w d, shape::Memory s) { this->encoder.alu(alu_op(op), d.id, memory(s)); }
+		void arithmetic(Operator op, shape::Memory d, shape::x s) { this->encoder.alu(alu_op(op), memory(d), s.id); }
+		void arithmetic(Operator op, shape::Memory d, shape::Number s) { this->encoder.alu(alu_op(op), memory(d), immediate(s.value)); }
+
+		// the count register is always rcx, so it isn't an operand of the encoding
+		void shift(ShiftOp op, shape::w d, shape::sx s) { this->encoder.shift(op, d.id); }
+		void shift(ShiftOp op, shape::w d, shape::Number s) { this->encoder.shift(op, d.id, shift_count(s.value)); }
+
+		void call(shape::w callee) { this->encoder.jmp(callee.id); }
+		void call(shape::Label callee) {
+			this->builder.reference(this->encoder.jmp(), callee.symbol, MachineCodeBuilder::ReferenceKind::rel32);
+		}
+
+		// cmp of `lhs op rhs`; a constant lhs swaps the sides
+		Condition compare(Operator op, shape::x lhs, shape::x rhs) {
+			this->encoder.alu(AluOp::cmp, lhs.id, rhs.id);
+			return condition(op);
+		}
+		Condition compare(Operator op, shape::x lhs, shape::Number rhs) {
+			this->encoder.alu(AluOp::cmp, lhs.id, immediate(rhs.value));
+			return condition(op);
+		}
+		Condition compare(Operator op, shape::Number lhs, shape::x rhs) {
+			this->encoder.alu(AluOp::cmp, rhs.id, immediate(lhs.value));
+			return swapped_condition(op);
+		}
+	};
+
+	// MachineCodeBuilder methods
+
+	MachineCodeBuilder::MachineCodeBuilder() : entry_point_size {0} {}
+
+	void MachineCodeBuilder::begin(SymbolID entryPointLabel) {
+		for (RegisterID r : callee_saved_registers) {
+			this->encoder.push(r);
+		}
+		this->reference(this->encoder.call(), entryPointLabel, ReferenceKind::rel32);
+		for (int r = 5; r >= 0; r--) {
+			this->encoder.pop(callee_saved_registers[r]);
+		}
+		this->encoder.ret();
+		this->entry_point_size = this->encoder.size();
+	}
+
+	void MachineCodeBuilder::add_function(const Function &f, const SymbolTable &symbols, const CodeGenerationOptions &options) {
+		std::size_t begin = this->encoder.size();
+		this->define(f.name, symbols);
+
+		// the locals live between rsp and the return address
+		if (f.num_locals > 0) {
+			this->encoder.alu(AluOp::sub, RegisterID::rsp, immediate(8 * f.num_locals));
+		}
+
+		MachineCodeSelector selector(*this, f, symbols);
+		CompareBranchFinder compare_branches(f);
+		if (!options.lay_out_blocks) {
+			for (std::size_t k = 0; k < f.instructions.size(); k++) {
+				CompareBranch branch;
+				if (compare_branches.find(k, branch)) {
+					selector.compare_branch(branch, false, {&branch.cjump->label, 0});
+					k++;
+					continue;
+				}
+				f.instructions[k]->accept(selector);
+			}
+			this->functions.push_back({f.name, begin, this->encoder.size()});
+			return;
+		}
+
+		ControlFlowGraph cfg(f);
+		FunctionProfile profile;
+		bool profiled = options.profile && options.profile->find(f, cfg, symbols, profile);
+		BlockLayout layout(f, cfg, profiled ? &profile : nullptr);
+		selector.block_offsets.resize(cfg.blocks.size());
+		layout.write(f, cfg, compare_branches, selector);
+		for (auto [offset, b] : selector.block_jumps) {
+			this->encoder.patch_rel32(offset, selector.block_offsets[b]);
+		}
+		this->functions.push_back({f.name, begin, this->encoder.size()});
+	}
+
+	void MachineCodeBuilder::define(SymbolID symbol, const SymbolTable &symbols) {
+		if (symbol >= this->symbol_offsets.size()) {
+			this->symbol_offsets.resize(symbols.size(), -1);
+		}
+		if (this->symbol_offsets[symbol] >= 0) {
+			throw std::runtime_error("_" + symbols.name(symbol) + " is defined more than once");
+		}
+		this->symbol_offsets[symbol] = this->encoder.size();
+	}
+
+	void MachineCodeBuilder::reference(std::size_t offset, SymbolID target, ReferenceKind kind) {
+		this->label_references.push_back({offset, target, kind});
+	}
+
+	void MachineCodeBuilder::resolve_labels(const SymbolTable &symbols) {
+		this->symbol_offsets.resize(symbols.size(), -1);
+		for (const LabelReference &r : this->label_references) {
+			int64_t target = this->symbol_offsets[r.target];
+			if (target < 0) {
+				throw std::runtime_error("_" + symbols.name(r.target) + " is never defined");
+			}
+			if (r.kind == ReferenceKind::rel32) {
+				this->encoder.patch_rel32(r.offset, target);
+			}
+		}
+	}
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <L1.h>
+#include <code_generator.h>
+#include <x86_encoder.h>
+
+namespace L1 {
+
+	/*
+	 * Machine code of a program before it is linked: the encoded bytes plus
+	 * every place that refers to an address not known while encoding.
+	 *
+	 * References to labels and functions are jumps, calls, and rip-relative
+	 * leas (rel32, resolved here once everything is encoded) and label
+	 * addresses stored to memory (abs32, left to whoever places the code).
+	 * Calls to the runtime are left to whoever places the code too.
+	 */
+	class MachineCodeBuilder {
+		public:
+
+		enum struct ReferenceKind {
+			rel32,
+			abs32
+		};
+
+		// the 32-bit field at `offset` must refer to `target`
+		struct LabelReference {
+			std::size_t offset;
+			SymbolID target;
+			ReferenceKind kind;
+		};
+
+		// the rel32 of a call at `offset` must reach `function`
+		struct RuntimeCall {
+			std::size_t offset;
+			RuntimeFunction function;
+			int64_t num_arguments;
+		};
+
+		struct FunctionRange {
+			SymbolID name;
+			std::size_t begin;
+			std::size_t end;
+		};
+
+		X86Encoder encoder;
+
+		// offset of each label and function, by SymbolID; -1 if not defined
+		std::vector<int64_t> symbol_offsets;
+
+		// offset 0 to the end of the entry point wrapper
+		std::size_t entry_point_size;
+		std::vector<FunctionRange> functions;
+		// the labels defined inside functions, in order
+		std::vector<SymbolID> labels;
+
+		std::vector<LabelReference> label_references;
+		std::vector<RuntimeCall> runtime_calls;
+
+		MachineCodeBuilder();
+
+		// "go", which calls the entry point; must come first
+		void begin(SymbolID entryPointLabel);
+
+		// `options.instrument` is left to the assembly generator
+		void add_function(const Function &f, const SymbolTable &symbols, const CodeGenerationOptions &options = {});
+
+		/*
+		 * Fills in every rel32 label reference. Throws if a referenced label
+		 * or function is never defined.
+		 */
+		void resolve_labels(const SymbolTable &symbols);
+
+		// records that `symbol` is defined at the current offset
+		void define(SymbolID symbol, const SymbolTable &symbols);
+
+		void reference(std::size_t offset, SymbolID target, ReferenceKind kind);
+	};
+}
@@ -0,0 +1,206 @@
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <elf.h>
+
+#include <object_generator.h>
+#include <output_buffer.h>
+
+namespace L1 {
+	// section indices
+	enum : uint16_t {
+		section_null,
+		section_text,
+		section_rela_text,
+		section_symtab,
+		section_strtab,
+		section_shstrtab,
+		section_note_gnu_stack,
+		num_sections
+	};
+
+	// a string table under construction
+	struct StringTable {
+		std::string data {'\0'};
+
+		uint32_t add(std::string_view s) {
+			uint32_t offset = this->data.size();
+			this->data.append(s);
+			this->data.push_back('\0');
+			return offset;
+		}
+	};
+
+	static Elf64_Sym make_symbol(uint32_t name, unsigned char binding, unsigned char type, uint16_t section, uint64_t value, uint64_t size) {
+		Elf64_Sym s;
+		std::memset(&s, 0, sizeof(s));
+		s.st_name = name;
+		s.st_info = ELF64_ST_INFO(binding, type);
+		s.st_shndx = section;
+		s.st_value = value;
+		s.st_size = size;
+		return s;
+	}
+
+	static void append_padding(OutputBuffer &output, std::size_t &offset, std::size_t alignment) {
+		while (offset % alignment != 0) {
+			output.append('\0');
+			offset++;
+		}
+	}
+
+	template<typename T>
+	static void append_struct(OutputBuffer &output, const T &value) {
+		output.append(reinterpret_cast<const char *>(&value), sizeof(T));
+	}
+
+	// ObjectGenerator methods
+
+	ObjectGenerator::ObjectGenerator(const std::string &outputFileName, const CodeGenerationOptions &options) :
+		outputFileName {outputFileName},
+		options {options}
+	{}
+
+	void ObjectGenerator::begin(SymbolID entryPointLabel, const SymbolTable &symbols) {
+		this->builder.begin(entryPointLabel);
+	}
+
+	void ObjectGenerator::generate(const Function &f, const SymbolTable &symbols) {
+		this->builder.add_function(f, symbols, this->options);
+	}
+
+	void ObjectGenerator::end(const SymbolTable &symbols) {
+		this->builder.resolve_labels(symbols);
+		const std::vector<uint8_t> &text = this->builder.encoder.code;
+
+		/*
+		 * Symbols: the null symbol, .text, the functions and labels, then the
+		 * globals (go and the runtime functions that are called).
+		 */
+		StringTable strtab;
+		std::vector<Elf64_Sym> symtab;
+		symtab.push_back(make_symbol(0, STB_LOCAL, STT_NOTYPE, SHN_UNDEF, 0, 0));
+		const uint32_t text_symbol = symtab.size();
+		symtab.push_back(make_symbol(0, STB_LOCAL, STT_SECTION, section_text, 0, 0));
+		for (const auto &f : this->builder.functions) {
+			uint32_t name = strtab.add("_" + symbols.name(f.name));
+			symtab.push_back(make_symbol(name, STB_LOCAL, STT_FUNC, section_text, f.begin, f.end - f.begin));
+		}
+		for (SymbolID label : this->builder.labels) {
+			uint32_t name = strtab.add("_" + symbols.name(label));
+			symtab.push_back(make_symbol(name, STB_LOCAL, STT_NOTYPE, section_text, this->builder.symbol_offsets[label], 0));
+		}
+		const uint32_t first_global = symtab.size();
+		symtab.push_back(make_symbol(strtab.add("go"), STB_GLOBAL, STT_FUNC, section_text, 0, this->builder.entry_point_size));
+
+		uint32_t runtime_symbols[num_runtime_functions] = {};
+		for (const auto &call : this->builder.runtime_calls) {
+			uint32_t &index = runtime_symbols[static_cast<int>(call.function)];
+			if (index == 0) {
+				index = symtab.size();
+				uint32_t name = strtab.add(runtime_function_name(call.function));
+				symtab.push_back(make_symbol(name, STB_GLOBAL, STT_NOTYPE, SHN_UNDEF, 0, 0));
+			}
+		}
+
+		/*
+		 * Relocations.
+		 */
+		std::vector<Elf64_Rela> relocations;
+		for (const auto &call : this->builder.runtime_calls) {
+			uint32_t symbol = runtime_symbols[static_cast<int>(call.function)];
+			relocations.push_back({call.offset, ELF64_R_INFO(symbol, R_X86_64_PLT32), -4});
+		}
+		for (const auto &r : this->builder.label_references) {
+			if (r.kind == MachineCodeBuilder::ReferenceKind::abs32) {
+				int64_t target = this->builder.symbol_offsets[r.target];
+				relocations.push_back({r.offset, ELF64_R_INFO(text_symbol, R_X86_64_32S), target});
+			}
+		}
+
+		StringTable shstrtab;
+		uint32_t name_text = shstrtab.add(".text");
+		uint32_t name_rela_text = shstrtab.add(".rela.text");
+		uint32_t name_symtab = shstrtab.add(".symtab");
+		uint32_t name_strtab = shstrtab.add(".strtab");
+		uint32_t name_shstrtab = shstrtab.add(".shstrtab");
+		uint32_t name_note_gnu_stack = shstrtab.add(".note.GNU-stack");
+
+		/*
+		 * Layout: header, .text, .rela.text, .symtab, .strtab, .shstrtab,
+		 * then the section headers.
+		 */
+		std::size_t offset_text = sizeof(Elf64_Ehdr);
+		std::size_t offset_rela = (offset_text + text.size() + 7) & ~(std::size_t)7;
+		std::size_t size_rela = relocations.size() * sizeof(Elf64_Rela);
+		std::size_t offset_symtab = offset_rela + size_rela;
+		std::size_t size_symtab = symtab.size() * sizeof(Elf64_Sym);
+		std::size_t offset_strtab = offset_symtab + size_symtab;
+		std::size_t offset_shstrtab = offset_strtab + strtab.data.size();
+		std::size_t offset_sections = (offset_shstrtab + shstrtab.data.size() + 7) & ~(std::size_t)7;
+
+		Elf64_Shdr sections[num_sections];
+		std::memset(sections, 0, sizeof(sections));
+		auto section = [&](uint16_t index, uint32_t name, uint32_t type, uint64_t flags, std::size_t offset, std::size_t size, uint64_t alignment) {
+			sections[index].sh_name = name;
+			sections[index].sh_type = type;
+			sections[index].sh_flags = flags;
+			sections[index].sh_offset = offset;
+			sections[index].sh_size = size;
+			sections[index].sh_addralign = alignment;
+		};
+		section(section_text, name_text, SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, offset_text, text.size(), 16);
+		section(section_rela_text, name_rela_text, SHT_RELA, SHF_INFO_LINK, offset_rela, size_rela, 8);
+		sections[section_rela_text].sh_link = section_symtab;
+		sections[section_rela_text].sh_info = section_text;
+		sections[section_rela_text].sh_entsize = sizeof(Elf64_Rela);
+		section(section_symtab, name_symtab, SHT_SYMTAB, 0, offset_symtab, size_symtab, 8);
+		sections[section_symtab].sh_link = section_strtab;
+		sections[section_symtab].sh_info = first_global;
+		sections[section_symtab].sh_entsize = sizeof(Elf64_Sym);
+		section(section_strtab, name_strtab, SHT_STRTAB, 0, offset_strtab, strtab.data.size(), 1);
+		section(section_shstrtab, name_shstrtab, SHT_STRTAB, 0, offset_shstrtab, shstrtab.data.size(), 1);
+		section(section_note_gnu_stack, name_note_gnu_stack, SHT_PROGBITS, 0, offset_sections, 0, 1);
+
+		Elf64_Ehdr header;
+		std::memset(&header, 0, sizeof(header));
+		std::memcpy(header.e_ident, ELFMAG, SELFMAG);
+		header.e_ident[EI_CLASS] = ELFCLASS64;
+		header.e_ident[EI_DATA] = ELFDATA2LSB;
+		header.e_ident[EI_VERSION] = EV_CURRENT;
+		header.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+		header.e_type = ET_REL;
+		header.e_machine = EM_X86_64;
+		header.e_version = EV_CURRENT;
+		header.e_shoff = offset_sections;
+		header.e_ehsize = sizeof(Elf64_Ehdr);
+		header.e_shentsize = sizeof(Elf64_Shdr);
+		header.e_shnum = num_sections;
+		header.e_shstrndx = section_shstrtab;
+
+		/*
+		 * Write everything out.
+		 */
+		OutputBuffer output(this->outputFileName);
+		std::size_t offset = 0;
+		append_struct(output, header);
+		output.append(reinterpret_cast<const char *>(text.data()), text.size());
+		offset = offset_text + text.size();
+		append_padding(output, offset, 8);
+		for (const auto &r : relocations) {
+			append_struct(output, r);
+		}
+		for (const auto &s : symtab) {
+			append_struct(output, s);
+		}
+		output.append(strtab.data);
+		output.append(shstrtab.data);
+		offset = offset_shstrtab + shstrtab.data.size();
+		append_padding(output, offset, 8);
+		for (const auto &s : sections) {
+			append_struct(output, s);
+		}
+		output.close();
+	}
+}
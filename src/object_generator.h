@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+
+#include <code_generator.h>
+#include <machine_code.h>
+
+namespace L1 {
+	/*
+	 * Encodes the machine code directly and writes a relocatable ELF64
+	 * object, so no assembler is needed.
+	 *
+	 * "go" is the only global symbol; every function and label gets a local
+	 * symbol with the same name as in the assembly output. Jumps and calls
+	 * between functions are resolved here; the object only has relocations
+	 * for calls into the runtime and for label addresses stored to memory.
+	 */
+	class ObjectGenerator : public CodeGenerator {
+		public:
+
+		ObjectGenerator(const std::string &outputFileName, const CodeGenerationOptions &options = {});
+
+		virtual void begin(SymbolID entryPointLabel, const SymbolTable &symbols) override;
+		virtual void generate(const Function &f, const SymbolTable &symbols) override;
+		virtual void end(const SymbolTable &symbols) override;
+
+		private:
+
+		std::string outputFileName;
+		MachineCodeBuilder builder;
+		CodeGenerationOptions options;
+	};
+}
@@ -0,0 +1,60 @@
+#include <charconv>
+#include <stdexcept>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <output_buffer.h>
+
+namespace L1 {
+	OutputBuffer::OutputBuffer(const std::string &fileName, std::size_t capacity) :
+		fd {open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)},
+		data {new char[capacity]},
+		capacity {capacity},
+		size {0}
+	{
+		if (this->fd < 0) {
+			throw std::runtime_error("unable to open " + fileName);
+		}
+	}
+
+	OutputBuffer::~OutputBuffer() {
+		if (this->fd >= 0) {
+			::close(this->fd);
+		}
+	}
+
+	void OutputBuffer::append_number(int64_t value) {
+		// 20 characters hold any int64_t
+		if (this->capacity - this->size < 20) {
+			this->flush();
+		}
+		char *begin = this->data.get() + this->size;
+		this->size = std::to_chars(begin, begin + 20, value).ptr - this->data.get();
+	}
+
+	void OutputBuffer::flush() {
+		this->write_all(this->data.get(), this->size);
+		this->size = 0;
+	}
+
+	void OutputBuffer::close() {
+		this->flush();
+		::close(this->fd);
+		this->fd = -1;
+	}
+
+	void OutputBuffer::write_all(const char *data, std::size_t size) {
+		while (size > 0) {
+			ssize_t written = write(this->fd, data, size);
+			if (written < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				throw std::runtime_error("unable to write the output file");
+			}
+			data += written;
+			size -= written;
+		}
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace L1 {
+
+	/*
+	 * Write-only file with a large preallocated buffer.
+	 * The buffer is handed to write(2) only when it fills up and on flush(),
+	 * so emitting a line is just a few memcpy's.
+	 */
+	class OutputBuffer {
+		public:
+
+		// creates (or truncates) the file
+		OutputBuffer(const std::string &fileName, std::size_t capacity = 4 << 20);
+		OutputBuffer(const OutputBuffer &) = delete;
+		OutputBuffer &operator=(const OutputBuffer &) = delete;
+
+		// closes the file without flushing; call close() to keep the output
+		~OutputBuffer();
+
+		void append(const char *data, std::size_t size) {
+			if (size > this->capacity - this->size) {
+				this->flush();
+				if (size > this->capacity) {
+					this->write_all(data, size);
+					return;
+				}
+			}
+			std::memcpy(this->data.get() + this->size, data, size);
+			this->size += size;
+		}
+
+		void append(std::string_view text) {
+			this->append(text.data(), text.size());
+		}
+
+		void append(char c) {
+			if (this->size == this->capacity) {
+				this->flush();
+			}
+			this->data[this->size++] = c;
+		}
+
+		// decimal
+		void append_number(int64_t value);
+
+		void flush();
+
+		// flushes and closes the file
+		void close();
+
+		private:
+
+		void write_all(const char *data, std::size_t size);
+
+		int fd;
+		std::unique_ptr<char[]> data;
+		std::size_t capacity;
+		std::size_t size;
+	};
+}
@@ -0,0 +1,69 @@
+#include <chrono>
+#include <iostream>
+#include <cstdlib>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <parser.h>
+
+void print_help(char *progName) {
+	std::cerr << "Usage: " << progName << " [-r REPETITIONS] [-p pegtl|handwritten|parallel] [-j THREADS] SOURCE..." << std::endl;
+	return;
+}
+
+/*
+ * Parses every SOURCE several times and reports the parsing throughput in
+ * instructions per second.
+ */
+int main(
+	int argc,
+	char **argv
+) {
+	int64_t repetitions = 10;
+	L1::ParserKind parser = L1::ParserKind::pegtl;
+	unsigned num_threads = 0;
+
+	int32_t opt;
+	while ((opt = getopt(argc, argv, "r:p:j:")) != -1) {
+		switch (opt) {
+			case 'r':
+				repetitions = strtoul(optarg, NULL, 0);
+				break;
+			case 'p':
+				if (!L1::parser_kind_from_string(optarg, parser)) {
+					print_help(argv[0]);
+					return 1;
+				}
+				break;
+			case 'j':
+				num_threads = strtoul(optarg, NULL, 0);
+				break;
+			default:
+				print_help(argv[0]);
+				return 1;
+		}
+	}
+	if (optind >= argc) {
+		print_help(argv[0]);
+		return 1;
+	}
+
+	for (int32_t arg = optind; arg < argc; arg++) {
+		int64_t num_instructions = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (int64_t r = 0; r < repetitions; r++) {
+			L1::Program p = L1::parse_file(argv[arg], parser, num_threads);
+			for (const L1::Function *f : p.functions) {
+				num_instructions += f->instructions.size();
+			}
+		}
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+		std::cout << argv[arg] << ": "
+			<< num_instructions / repetitions << " instructions, "
+			<< elapsed.count() / repetitions * 1000 << " ms per parse, "
+			<< (int64_t)(num_instructions / elapsed.count()) << " instructions/s" << std::endl;
+	}
+
+	return 0;
+}
@@ -22,13 +22,18 @@
 #include <cstdlib>
 #include <stdint.h>
 #include <assert.h>
+#include <charconv>
+#include <string_view>
 
 #include <tao/pegtl.hpp>
-#include <tao/pegtl/contrib/analyze.hpp>
 #include <tao/pegtl/contrib/raw_string.hpp>
+#ifdef L1_GRAMMAR_CHECK
+#include <tao/pegtl/contrib/analyze.hpp>
+#endif
 
 #include <L1.h>
 #include <parser.h>
+#include <handwritten_parser.h>
 
 namespace pegtl = TAO_PEGTL_NAMESPACE;
 
@@ -37,12 +42,37 @@ using namespace pegtl;
 namespace L1 {
 
 	/*
-	 * Stack of tokens parsed
+	 * Everything a parse needs besides the input, passed to every action as
+	 * the PEGTL action state. Nothing is shared between parses, so any number
+	 * of files can be parsed concurrently.
 	 */
-	std::vector<Item *> parsed_items;
+	struct ParseState {
+		Program &program;
 
-	template<typename Rule>
-	struct with_lookahead : seq<at<Rule>, Rule> {};
+		/*
+		 * Stack of tokens parsed
+		 */
+		std::vector<Operand> parsed_operands;
+		std::vector<Operator> parsed_operators;
+
+		ParseState(Program &program) : program {program} {}
+
+		Operand pop_operand() {
+			Operand operand = this->parsed_operands.back();
+			this->parsed_operands.pop_back();
+			return operand;
+		}
+
+		Operator pop_operator() {
+			Operator op = this->parsed_operators.back();
+			this->parsed_operators.pop_back();
+			return op;
+		}
+
+		void add_instruction(Instruction *i) {
+			this->program.functions.back()->instructions.push_back(i);
+		}
+	};
 
 	template<typename SpecificRule, typename GeneralRule>
 	struct upcast : seq<at<SpecificRule>, GeneralRule> {};
@@ -280,9 +310,10 @@ namespace L1 {
 	> {};
 
 	// "cmp" in the grammar
+	// (str_le must come before its prefix str_lt)
 	struct comparison_operator : sor<
-		str_lt,
 		str_le,
+		str_lt,
 		str_eq
 	> {};
 
@@ -322,26 +353,8 @@ namespace L1 {
 		>
 	> {};
 
-	struct Instruction_return_rule : seq<
-		str_return
-	> {};
-
-
-	// TODO distinguish between the different classes of registers "w", "a", etc
-	// also add the different types of assignments
-	struct Instruction_assignment_rule : seq<
-		register_writable_rule,
-		spaces,
-		str_arrow,
-		spaces,
-		source_value_rule
-	> {};
-
-	struct Instruction_memory_read_rule : seq<
-		register_writable_rule,
-		spaces,
-		str_arrow,
-		spaces,
+	// "mem x M" in the grammar
+	struct memory_location_rule : seq<
 		str_mem,
 		spaces,
 		register_any_rule,
@@ -349,101 +362,30 @@ namespace L1 {
 		number
 	> {};
 
+	/*
+	 * Instructions.
+	 * Each instruction is recognized in a single forward pass: the leading
+	 * token ("return", "goto", "cjump", "call", ":", "mem", or a register)
+	 * selects a family, and within a family the next token picks the form.
+	 * An alternative is only entered once its first token has matched, so no
+	 * part of a line is matched twice and no action fires for an alternative
+	 * that is later abandoned.
+	 *
+	 * Forms that share a prefix end in an empty marker rule; its action
+	 * builds the instruction from the operands pushed while matching.
+	 */
+	struct Instruction_assignment_rule : success {};
 
-	struct Instruction_memory_write_rule : seq<
-		str_mem,
-		spaces,
-		register_any_rule,
-		spaces,
-		number,
-		spaces,
-		str_arrow,
-		spaces,
-		register_writable_rule
-	> {};
-
-	struct Instruction_arithmetic_operation_rule : seq<
-		register_writable_rule,
-		spaces,
-		arithmetic_operator,
-		spaces,
-		arithmetic_value_rule
-	> {};
-
-	struct Instruction_shift_operation_register_rule : seq<
-		register_writable_rule,
-		spaces,
-		shift_operator,
-		spaces,
-		register_shift_rule
-	> {};
-
-	struct Instruction_shift_operation_immediate_rule : seq<
-		register_writable_rule,
-		spaces,
-		shift_operator,
-		spaces,
-		number
-	> {};
-
-	struct Instruction_plus_write_memory_rule : seq<
-		str_mem,
-		spaces,
-		register_any_rule,
-		spaces,
-		number,
-		spaces,
-		str_plus,
-		spaces,
-		arithmetic_value_rule
-	> {};
-
-	struct Instruction_minus_write_memory_rule : seq<
-		str_mem,
-		spaces,
-		register_any_rule,
-		spaces,
-		number,
-		spaces,
-		str_minus,
-		spaces,
-		arithmetic_value_rule
-	> {};
+	struct Instruction_arithmetic_rule : success {};
 
-	struct Instruction_plus_read_memory_rule : seq<
-		register_writable_rule,
-		spaces,
-		str_plus,
-		spaces,
-		str_mem,
-		spaces,
-		register_any_rule,
-		spaces,
-		number
-	> {};
-
-	struct Instruction_minus_read_memory_rule : seq<
-		register_writable_rule,
-		spaces,
-		str_minus,
-		spaces,
-		str_mem,
-		spaces,
-		register_any_rule,
-		spaces,
-		number
+	struct Instruction_return_rule : seq<
+		str_return
 	> {};
 
-	struct Instruction_assignment_compare_rule : seq<
-		register_writable_rule,
-		spaces,
-		str_arrow,
-		spaces,
-		arithmetic_value_rule,
-		spaces,
-		comparison_operator,
+	struct Instruction_goto_rule : seq<
+		str_goto,
 		spaces,
-		arithmetic_value_rule
+		label
 	> {};
 
 	struct Instruction_cjump_rule : seq<
@@ -458,77 +400,126 @@ namespace L1 {
 		label
 	> {};
 
-	struct Instruction_goto_rule : seq<
-		str_goto,
-		spaces,
+	struct Instruction_label_rule : seq<
 		label
 	> {};
 
-	struct Instruction_call_rule : seq<
-		str_call,
-		spaces,
-		call_dest_rule,
-		spaces,
-		number
-	> {};
-
+	/*
+	 * Instructions starting with "call".
+	 */
 	struct Instruction_call_print_rule : seq<
-		str_call,
-		spaces,
 		str_print,
 		spaces,
 		one<'1'>
 	> {};
 
 	struct Instruction_call_input_rule : seq<
-		str_call,
-		spaces,
 		str_input,
 		spaces,
 		one<'0'>
 	> {};
 
 	struct Instruction_call_allocate_rule : seq<
-		str_call,
-		spaces,
 		str_allocate,
 		spaces,
 		one<'2'>
 	> {};
 
 	struct Instruction_call_tuple_error_rule : seq<
-		str_call,
-		spaces,
 		str_tuple_error,
 		spaces,
 		one<'3'>
 	> {};
 
 	struct Instruction_call_tensor_error_rule : seq<
-		str_call,
-		spaces,
 		str_tensor_error,
 		spaces,
 		tensor_error_arg_number
 	>{};
 
-	struct Instruction_writable_increment_rule : seq<
-		register_writable_rule,
+	struct Instruction_call_function_rule : seq<
+		call_dest_rule,
+		spaces,
+		number
+	> {};
+
+	struct Instruction_call_rule : seq<
+		str_call,
+		spaces,
+		sor<
+			Instruction_call_print_rule,
+			Instruction_call_input_rule,
+			Instruction_call_allocate_rule,
+			Instruction_call_tuple_error_rule,
+			Instruction_call_tensor_error_rule,
+			Instruction_call_function_rule
+		>
+	> {};
+
+	/*
+	 * Instructions starting with "mem x M".
+	 */
+	struct Instruction_memory_rule : seq<
+		memory_location_rule,
+		spaces,
+		sor<
+			// "mem x M <- s"
+			seq<str_arrow, spaces, source_value_rule, Instruction_assignment_rule>,
+			// "mem x M += t" and "mem x M -= t"
+			seq<sor<str_plus, str_minus>, spaces, arithmetic_value_rule, Instruction_arithmetic_rule>
+		>
+	> {};
+
+	/*
+	 * Instructions starting with a register "w".
+	 */
+
+	// "w <- t" followed by " cmp t"
+	struct Instruction_assignment_compare_rule : seq<
+		spaces,
+		comparison_operator,
+		spaces,
+		arithmetic_value_rule
+	> {};
+
+	// "w <- s", "w <- mem x M", and "w <- t cmp t"
+	struct register_assignment_rule : seq<
+		str_arrow,
+		spaces,
+		sor<
+			seq<arithmetic_value_rule, sor<Instruction_assignment_compare_rule, Instruction_assignment_rule>>,
+			seq<sor<memory_location_rule, label, function_name_rule>, Instruction_assignment_rule>
+		>
+	> {};
+
+	// "w aop t", "w += mem x M", and "w -= mem x M"
+	struct register_arithmetic_rule : sor<
+		seq<sor<str_plus, str_minus>, spaces, sor<memory_location_rule, arithmetic_value_rule>, Instruction_arithmetic_rule>,
+		seq<sor<str_times, str_bitwise_and>, spaces, arithmetic_value_rule, Instruction_arithmetic_rule>
+	> {};
+
+	// "w sop sx" and "w sop N"
+	struct Instruction_shift_operation_rule : seq<
+		shift_operator,
 		spaces,
+		sor<
+			register_shift_rule,
+			number
+		>
+	> {};
+
+	struct Instruction_writable_increment_rule : seq<
 		one<'+'>,
 		one<'+'>
 	> {};
 
 	struct Instruction_writable_decrement_rule : seq<
-		register_writable_rule,
-		spaces,
 		one<'-'>,
 		one<'-'>
 	> {};
 
+	// "w @ w w E"
 	struct Instruction_leaq_rule : seq<
-		register_writable_rule,
-		spaces,
 		one<'@'>,
 		spaces,
 		register_writable_rule,
@@ -538,31 +529,27 @@ namespace L1 {
 		lea_factor
 	> {};
 
+	struct Instruction_register_rule : seq<
+		register_writable_rule,
+		spaces,
+		sor<
+			register_assignment_rule,
+			register_arithmetic_rule,
+			Instruction_shift_operation_rule,
+			Instruction_writable_increment_rule,
+			Instruction_writable_decrement_rule,
+			Instruction_leaq_rule
+		>
+	> {};
+
 	struct Instruction_rule : sor<
-		with_lookahead<Instruction_return_rule>,
-		with_lookahead<Instruction_assignment_rule>,
-		with_lookahead<Instruction_memory_read_rule>,
-		with_lookahead<Instruction_memory_write_rule>,
-		with_lookahead<Instruction_arithmetic_operation_rule>,
-		with_lookahead<Instruction_shift_operation_register_rule>,
-		with_lookahead<Instruction_shift_operation_immediate_rule>,
-		with_lookahead<Instruction_plus_write_memory_rule>,
-		with_lookahead<Instruction_plus_read_memory_rule>,
-		with_lookahead<Instruction_minus_write_memory_rule>,
-		with_lookahead<Instruction_minus_read_memory_rule>,
-		with_lookahead<Instruction_assignment_compare_rule>,
-		with_lookahead<Instruction_cjump_rule>,
-		with_lookahead<label>,
-		with_lookahead<Instruction_goto_rule>,
-		with_lookahead<Instruction_call_rule>,
-		with_lookahead<Instruction_call_print_rule>,
-		with_lookahead<Instruction_call_input_rule>,
-		with_lookahead<Instruction_call_allocate_rule>,
-		with_lookahead<Instruction_call_tuple_error_rule>,
-		with_lookahead<Instruction_call_tensor_error_rule>,
-		with_lookahead<Instruction_writable_increment_rule>,
-		with_lookahead<Instruction_writable_decrement_rule>,
-		with_lookahead<Instruction_leaq_rule>
+		Instruction_return_rule,
+		Instruction_goto_rule,
+		Instruction_cjump_rule,
+		Instruction_call_rule,
+		Instruction_label_rule,
+		Instruction_memory_rule,
+		Instruction_register_rule
 	> {};
 
 	struct Instructions_rule : plus<
@@ -575,10 +562,14 @@ namespace L1 {
 		>
 	> {};
 
+	struct function_header_rule : seq<
+		function_name_rule
+	> {};
+
 	struct Function_rule: seq<
 		seq<spaces, one< '(' >>,
 		seps_with_comments,
-		seq<spaces, function_name_rule>,
+		seq<spaces, function_header_rule>,
 		seps_with_comments,
 		seq<spaces, argument_number>,
 		seps_with_comments,
@@ -596,11 +587,15 @@ namespace L1 {
 		seps_with_comments
 	> {};
 
+	struct entry_point_name_rule : seq<
+		function_name_rule
+	> {};
+
 	struct entry_point_rule : seq<
 		seps_with_comments,
 		seq<spaces, one< '(' >>,
 		seps_with_comments,
-		function_name_rule,
+		entry_point_name_rule,
 		seps_with_comments,
 		Functions_rule,
 		seps_with_comments,
@@ -618,465 +613,381 @@ namespace L1 {
 	template<typename Rule>
 	struct action : pegtl::nothing<Rule> {};
 
-	template<> struct action<register_rule> {
-		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			// std::cout << "saw a register |" << in.string() << "|" << std::endl;
-			parsed_items.push_back(new Register(in.string()));
-		}
-	};
-
 	template<> struct action<name> {
 		template<typename Input>
-		static void apply(const Input &in, Program &p) {
+		static void apply(const Input &in, ParseState &state) {
 			// std::cout << "saw a name |" << in.string() << "|" << std::endl;
 		}
 	};
 
 	template<> struct action<number> {
 		template<typename Input>
-		static void apply(const Input &in, Program &p) {
+		static void apply(const Input &in, ParseState &state) {
 			// std::cout << "saw a number |" << in.string() << "|" << std::endl;
-			parsed_items.push_back(new Number(std::stoll(in.string())) );
+			const char *begin = in.begin();
+			if (*begin == '+') {
+				begin++; // from_chars doesn't accept an explicit plus sign
+			}
+			int64_t value;
+			if (std::from_chars(begin, in.end(), value).ec != std::errc()) {
+				throw parse_error("number out of range", in.position());
+			}
+			state.parsed_operands.push_back(Operand::make_number(value));
 		}
 	};
 
 	// template<> struct action<tensor_error_arg_number> {
 	// 	template<typename Input>
-	// 	static void apply(const Input &in, Program &p) {
+	// 	static void apply(const Input &in, ParseState &state) {
 	// 		std::cout << "saw a tensor_error_arg_number |" << in.string() << "|" << std::endl;
 	// 	}
 	// };
 
 	// template<> struct action<lea_factor> {
 	// 	template<typename Input>
-	// 	static void apply(const Input &in, Program &p) {
+	// 	static void apply(const Input &in, ParseState &state) {
 	// 		std::cout << "saw a lea_factor |" << in.string() << "|" << std::endl;
 	// 	}
 	// };
 
 	// template<> struct action<argument_number> {
 	// 	template<typename Input>
-	// 	static void apply(const Input &in, Program &p) {
+	// 	static void apply(const Input &in, ParseState &state) {
 	// 		std::cout << "saw a argument_number |" << in.string() << "|" << std::endl;
 	// 	}
 	// };
 
 	// template<> struct action<local_number> {
 	// 	template<typename Input>
-	// 	static void apply(const Input &in, Program &p) {
+	// 	static void apply(const Input &in, ParseState &state) {
 	// 		std::cout << "saw a local_number |" << in.string() << "|" << std::endl;
 	// 	}
 	// };
 
 	template<> struct action<label> {
 		template<typename Input>
-		static void apply(const Input &in, Program &p) {
+		static void apply(const Input &in, ParseState &state) {
 			// std::cout << "saw a label |" << in.string() << "|" << std::endl;
-			parsed_items.push_back(new Label(in.string().substr(1)));
+			state.parsed_operands.push_back(Operand::make_label(state.program.symbols.intern(in.string_view().substr(1))));
 		}
 	};
 
 	template<> struct action<function_name_rule> {
 		template<typename Input>
-		static void apply(const Input &in, Program &p) {
+		static void apply(const Input &in, ParseState &state) {
 			// std::cout << "saw a function name |" << in.string() << "|" << std::endl;
-			parsed_items.push_back(new FunctionName(in.string().substr(1)));
+			state.parsed_operands.push_back(Operand::make_function_name(state.program.symbols.intern(in.string_view().substr(1))));
 		}
 	};
 
-	// template<> struct action<register_rax_rule> {
-	// 	template<typename Input>
-	// 	static void apply(const Input &in, Program &p) {
-	// 		std::cout << "saw a register_rax_rule | " << in.string() << std::endl;
-	// 	}
-	// };
-
-	// template<> struct action<register_rbx_rule> {
-	// 	template<typename Input>
-	// 	static void apply(const Input &in, Program &p) {
-	// 		std::cout << "saw a register_rbx_rule | " << in.string() << std::endl;
-	// 	}
-	// };
-
-	// template<> struct action<register_rcx_rule> {
-	// 	template<typename Input>
-	// 	static void apply(const Input &in, Program &p) {
-	// 		std::cout << "saw a register_rcx_rule | " << in.string() << std::endl;
-	// 	}
-	// };
-
-	// template<> struct action<register_rdx_rule> {
-	// 	template<typename Input>
-	// 	static void apply(const Input &in, Program &p) {
-	// 		std::cout << "saw a register_rdx_rule | " << in.string() << std::endl;
-	// 	}
-	// };
-
-	// template<> struct action<register_rdi_rule> {
-	// 	template<typename Input>
-	// 	static void apply(const Input &in, Program &p) {
-	// 		std::cout << "saw a struct register_rdi_rule | " << in.string() << std::endl;
-	// 	}
-	// };
-
-	// template<> struct action<register_rsi_rule> {
-	// 	template<typename Input>
-	// 	static void apply(const Input &in, Program &p) {
-	// 		std::cout << "saw a register_rsi_rule | " << in.string() << std::endl;
-	// 	}
-	// };
-
-	// template<> struct action<register_r8_rule> {
-	// 	template<typename Input>
-	// 	static void apply(const Input &in, Program &p) {
-	// 		std::cout << "saw a register_r8_rule | " << in.string() << std::endl;
-	// 	}
-	// };
-
-	// template<> struct action<register_r9_rule> {
-	// 	template<typename Input>
-	// 	static void apply(const Input &in, Program &p) {
-	// 		std::cout << "saw a register_r9_rule | " << in.string() << std::endl;
-	// 	}
-	// };
-
-	// template<> struct action<register_r10_rule> {
-	// 	template<typename Input>
-	// 	static void apply(const Input &in, Program &p) {
-	// 		std::cout << "saw a register_r10_rule | " << in.string() << std::endl;
-	// 	}
-	// };
-
-	// template<> struct action<register_r11_rule> {
-	// 	template<typename Input>
-	// 	static void apply(const Input &in, Program &p) {
-	// 		std::cout << "saw a register_r11_rule | " << in.string() << std::endl;
-	// 	}
-	// };
-
-	// template<> struct action<register_r12_rule> {
-	// 	template<typename Input>
-	// 	static void apply(const Input &in, Program &p) {
-	// 		std::cout << "saw a register_r12_rule | " << in.string() << std::endl;
-	// 	}
-	// };
-
-	// template<> struct action<register_r13_rule> {
-	// 	template<typename Input>
-	// 	static void apply(const Input &in, Program &p) {
-	// 		std::cout << "saw a register_r13_rule | " << in.string() << std::endl;
-	// 	}
-	// };
-
-	// template<> struct action<register_r14_rule> {
-	// 	template<typename Input>
-	// 	static void apply(const Input &in, Program &p) {
-	// 		std::cout << "saw a register_r14_rule | " << in.string() << std::endl;
-	// 	}
-	// };
-
-	// template<> struct action<register_r15_rule> {
-	// 	template<typename Input>
-	// 	static void apply(const Input &in, Program &p) {
-	// 		std::cout << "saw a register_r15_rule | " << in.string() << std::endl;
-	// 	}
-	// };
-
-	// template<> struct action<register_rbp_rule> {
-	// 	template<typename Input>
-	// 	static void apply(const Input &in, Program &p) {
-	// 		std::cout << "saw a register_rbp_rule | " << in.string() << std::endl;
-	// 	}
-	// };
-
-	// template<> struct action<register_rsp_rule> {
-	// 	template<typename Input>
-	// 	static void apply(const Input &in, Program &p) {
-	// 		std::cout << "saw a register_rsp_rule | " << in.string() << std::endl;
-	// 	}
-	// };
+	/*
+	 * Each register has its own rule, so the matched rule already tells us
+	 * which register it is; no need to look at the token text.
+	 */
+	template<RegisterID id>
+	struct register_action {
+		template<typename Input>
+		static void apply(const Input &in, ParseState &state) {
+			state.parsed_operands.push_back(Operand::make_register(id));
+		}
+	};
+
+	template<> struct action<register_rax_rule> : register_action<RegisterID::rax> {};
+	template<> struct action<register_rbx_rule> : register_action<RegisterID::rbx> {};
+	template<> struct action<register_rcx_rule> : register_action<RegisterID::rcx> {};
+	template<> struct action<register_rdx_rule> : register_action<RegisterID::rdx> {};
+	template<> struct action<register_rdi_rule> : register_action<RegisterID::rdi> {};
+	template<> struct action<register_rsi_rule> : register_action<RegisterID::rsi> {};
+	template<> struct action<register_r8_rule> : register_action<RegisterID::r8> {};
+	template<> struct action<register_r9_rule> : register_action<RegisterID::r9> {};
+	template<> struct action<register_r10_rule> : register_action<RegisterID::r10> {};
+	template<> struct action<register_r11_rule> : register_action<RegisterID::r11> {};
+	template<> struct action<register_r12_rule> : register_action<RegisterID::r12> {};
+	template<> struct action<register_r13_rule> : register_action<RegisterID::r13> {};
+	template<> struct action<register_r14_rule> : register_action<RegisterID::r14> {};
+	template<> struct action<register_r15_rule> : register_action<RegisterID::r15> {};
+	template<> struct action<register_rbp_rule> : register_action<RegisterID::rbp> {};
+	template<> struct action<register_rsp_rule> : register_action<RegisterID::rsp> {};
 
 	// template<> struct action<register_shift_rule> {
 	// 	template<typename Input>
-	// 	static void apply(const Input &in, Program &p) {
+	// 	static void apply(const Input &in, ParseState &state) {
 	// 		std::cout << "saw a register_shift_rule |" << in.string() << "|" << std::endl;
 	// 	}
 	// };
 
 	// template<> struct action<register_writable_rule> {
 	// 	template<typename Input>
-	// 	static void apply(const Input &in, Program &p) {
+	// 	static void apply(const Input &in, ParseState &state) {
 	// 		std::cout << "saw a register_writable_rule |" << in.string() << "|" << std::endl;
 	// 	}
 	// };
 
 	// template<> struct action<register_idk_rule> {
 	// 	template<typename Input>
-	// 	static void apply(const Input &in, Program &p) {
+	// 	static void apply(const Input &in, ParseState &state) {
 	// 		std::cout << "saw a register_idk_rule |" << in.string() << "|" << std::endl;
 	// 	}
 	// };
 
 	// template<> struct action<register_any_rule> {
 	// 	template<typename Input>
-	// 	static void apply(const Input &in, Program &p) {
+	// 	static void apply(const Input &in, ParseState &state) {
 	// 		std::cout << "saw a register |" << in.string() << "|" << std::endl;
 	// 	}
 	// };
 
-	template<> struct action<call_dest_rule> {
+	template<> struct action<memory_location_rule> {
 		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			std::cout << "saw a call_dest |" << in.string() << "|" << std::endl;
+		static void apply(const Input &in, ParseState &state) {
+			int64_t offset = state.pop_operand().value;
+			RegisterID base = state.pop_operand().reg;
+			state.parsed_operands.push_back(Operand::make_memory(base, offset));
 		}
 	};
 
-	template<> struct action<arithmetic_value_rule> {
+	template<Operator op>
+	struct operator_action {
 		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			std::cout << "saw an arithmetic value |" << in.string() << "|" << std::endl;
+		static void apply(const Input &in, ParseState &state) {
+			state.parsed_operators.push_back(op);
 		}
 	};
 
-	template<> struct action<source_value_rule> {
+	template<> struct action<str_plus> : operator_action<Operator::plus> {};
+	template<> struct action<str_minus> : operator_action<Operator::minus> {};
+	template<> struct action<str_times> : operator_action<Operator::times> {};
+	template<> struct action<str_bitwise_and> : operator_action<Operator::bitwise_and> {};
+	template<> struct action<str_lshift> : operator_action<Operator::lshift> {};
+	template<> struct action<str_rshift> : operator_action<Operator::rshift> {};
+	template<> struct action<str_lt> : operator_action<Operator::lt> {};
+	template<> struct action<str_le> : operator_action<Operator::le> {};
+	template<> struct action<str_eq> : operator_action<Operator::eq> {};
+
+	template<> struct action<entry_point_name_rule> {
 		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			std::cout << "saw a source value |" << in.string() << "|" << std::endl;
+		static void apply(const Input &in, ParseState &state) {
+			state.program.entryPointLabel = state.pop_operand().symbol;
 		}
 	};
 
-	template<> struct action<arithmetic_operator> {
+	template<> struct action<function_header_rule> {
 		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			std::cout << "saw an arithmetic operator |" << in.string() << "|" << std::endl;
+		static void apply(const Input &in, ParseState &state) {
+			Function *f = state.program.arena.make<Function>();
+			f->name = state.pop_operand().symbol;
+			state.program.functions.push_back(f);
 		}
 	};
 
-	template<> struct action<shift_operator> {
+	template<> struct action<argument_number> {
 		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			std::cout << "saw a shift operator |" << in.string() << "|" << std::endl;
+		static void apply(const Input &in, ParseState &state) {
+			state.program.functions.back()->num_arguments = state.pop_operand().value;
 		}
 	};
 
-	template<> struct action<comparison_operator> {
+	template<> struct action<local_number> {
 		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			std::cout << "saw a comparison operator |" << in.string() << "|" << std::endl;
+		static void apply(const Input &in, ParseState &state) {
+			state.program.functions.back()->num_locals = state.pop_operand().value;
 		}
 	};
 
 	template<> struct action<Instruction_return_rule> {
 		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			std::cout << "saw an instruction return |" << in.string() << "|" << std::endl;
+		static void apply(const Input &in, ParseState &state) {
+			state.add_instruction(state.program.arena.make<Instruction_ret>());
 		}
 	};
 
+	// "w <- s", "w <- mem x M", and "mem x M <- s" all have the same shape
 	template<> struct action<Instruction_assignment_rule> {
 		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			std::cout << "saw an Instruction_assignment_rule |" << in.string() << "|" << std::endl;
-		}
-	};
-
-	template<> struct action<Instruction_memory_read_rule> {
-		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			std::cout << "saw an instruction memory read |" << in.string() << "|" << std::endl;
-		}
-	};
-
-	template<> struct action<Instruction_memory_write_rule> {
-		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			std::cout << "saw an instruction memory write |" << in.string() << "|" << std::endl;
-		}
-	};
-
-	template<> struct action<Instruction_arithmetic_operation_rule> {
-		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			std::cout << "saw an instruction arithmetic_operation |" << in.string() << "|" << std::endl;
-		}
-	};
-
-	template<> struct action<Instruction_shift_operation_register_rule> {
-		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			std::cout << "saw a instruction shift operation register |" << in.string() << "|" << std::endl;
-		}
-	};
-
-	template<> struct action<Instruction_shift_operation_immediate_rule> {
-		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			std::cout << "saw a Instruction_shift_operation_immediate_rule |" << in.string() << "|" << std::endl;
-		}
-	};
-
-	template<> struct action<Instruction_plus_write_memory_rule> {
-		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			std::cout << "saw an instruction plus write |" << in.string() << "|" << std::endl;
+		static void apply(const Input &in, ParseState &state) {
+			auto i = state.program.arena.make<Instruction_assignment>();
+			i->source = state.pop_operand();
+			i->destination = state.pop_operand();
+			state.add_instruction(i);
 		}
 	};
 
-	template<> struct action<Instruction_minus_write_memory_rule> {
+	// every arithmetic form is "destination op source"
+	template<> struct action<Instruction_arithmetic_rule> {
 		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			std::cout << "saw a instructon minus write |" << in.string() << "|" << std::endl;
+		static void apply(const Input &in, ParseState &state) {
+			auto i = state.program.arena.make<Instruction_arithmetic>();
+			i->source = state.pop_operand();
+			i->op = state.pop_operator();
+			i->destination = state.pop_operand();
+			state.add_instruction(i);
 		}
 	};
 
-	template<> struct action<Instruction_plus_read_memory_rule> {
+	template<> struct action<Instruction_shift_operation_rule> {
 		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			std::cout << "saw a instruction plus read |" << in.string() << "|" << std::endl;
-		}
-	};
-
-	template<> struct action<Instruction_minus_read_memory_rule> {
-		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			std::cout << "saw a instruction minus read |" << in.string() << "|" << std::endl;
+		static void apply(const Input &in, ParseState &state) {
+			auto i = state.program.arena.make<Instruction_shift>();
+			i->source = state.pop_operand();
+			i->op = state.pop_operator();
+			i->destination = state.pop_operand();
+			state.add_instruction(i);
 		}
 	};
 
 	template<> struct action<Instruction_assignment_compare_rule> {
 		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			std::cout << "saw a Instruction_assignment_compare_rule |" << in.string() << "|" << std::endl;
+		static void apply(const Input &in, ParseState &state) {
+			auto i = state.program.arena.make<Instruction_compare_assignment>();
+			i->rhs = state.pop_operand();
+			i->op = state.pop_operator();
+			i->lhs = state.pop_operand();
+			i->destination = state.pop_operand();
+			state.add_instruction(i);
 		}
 	};
 
 	template<> struct action<Instruction_cjump_rule> {
 		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			std::cout << "saw a Instruction_cjump_rule |" << in.string() << "|" << std::endl;
+		static void apply(const Input &in, ParseState &state) {
+			auto i = state.program.arena.make<Instruction_cjump>();
+			i->label = state.pop_operand();
+			i->rhs = state.pop_operand();
+			i->op = state.pop_operator();
+			i->lhs = state.pop_operand();
+			state.add_instruction(i);
 		}
 	};
 
-	template<> struct action<Instruction_goto_rule> {
+	template<> struct action<Instruction_label_rule> {
 		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			std::cout << "saw a Instruction_goto_rule |" << in.string() << "|" << std::endl;
+		static void apply(const Input &in, ParseState &state) {
+			auto i = state.program.arena.make<Instruction_label>();
+			i->label = state.pop_operand();
+			state.add_instruction(i);
 		}
 	};
 
-	template<> struct action<Instruction_call_rule> {
-		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			std::cout << "saw a Instruction_call_rule |" << in.string() << "|" << std::endl;
-		}
-	};
-
-	template<> struct action<Instruction_call_print_rule> {
+	template<> struct action<Instruction_goto_rule> {
 		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			std::cout << "saw a Instruction_call_print_rule |" << in.string() << "|" << std::endl;
+		static void apply(const Input &in, ParseState &state) {
+			auto i = state.program.arena.make<Instruction_goto>();
+			i->label = state.pop_operand();
+			state.add_instruction(i);
 		}
 	};
 
-	template<> struct action<Instruction_call_input_rule> {
+	template<> struct action<Instruction_call_function_rule> {
 		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			std::cout << "saw a Instruction_call_input_rule |" << in.string() << "|" << std::endl;
+		static void apply(const Input &in, ParseState &state) {
+			auto i = state.program.arena.make<Instruction_call>();
+			i->num_arguments = state.pop_operand().value;
+			i->callee = state.pop_operand();
+			state.add_instruction(i);
 		}
 	};
 
-	template<> struct action<Instruction_call_allocate_rule> {
+	template<RuntimeFunction function, int64_t num_arguments>
+	struct call_runtime_action {
 		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			std::cout << "saw a Instruction_call_allocate_rule |" << in.string() << "|" << std::endl;
+		static void apply(const Input &in, ParseState &state) {
+			auto i = state.program.arena.make<Instruction_call_runtime>();
+			i->function = function;
+			i->num_arguments = num_arguments;
+			state.add_instruction(i);
 		}
 	};
 
-	template<> struct action<Instruction_call_tuple_error_rule> {
-		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			std::cout << "saw a Instruction_call_tuple_error_rule |" << in.string() << "|" << std::endl;
-		}
-	};
+	template<> struct action<Instruction_call_print_rule> : call_runtime_action<RuntimeFunction::print, 1> {};
+	template<> struct action<Instruction_call_input_rule> : call_runtime_action<RuntimeFunction::input, 0> {};
+	template<> struct action<Instruction_call_allocate_rule> : call_runtime_action<RuntimeFunction::allocate, 2> {};
+	template<> struct action<Instruction_call_tuple_error_rule> : call_runtime_action<RuntimeFunction::tuple_error, 3> {};
 
 	template<> struct action<Instruction_call_tensor_error_rule> {
 		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			std::cout << "saw a Instruction_call_tensor_error_rule |" << in.string() << "|" << std::endl;
+		static void apply(const Input &in, ParseState &state) {
+			auto i = state.program.arena.make<Instruction_call_runtime>();
+			i->function = RuntimeFunction::tensor_error;
+			i->num_arguments = state.pop_operand().value;
+			state.add_instruction(i);
 		}
 	};
 
 	template<> struct action<Instruction_writable_increment_rule> {
 		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			std::cout << "saw a Instruction_writable_increment_rule |" << in.string() << "|" << std::endl;
+		static void apply(const Input &in, ParseState &state) {
+			auto i = state.program.arena.make<Instruction_increment>();
+			i->destination = state.pop_operand();
+			state.add_instruction(i);
 		}
 	};
 
 	template<> struct action<Instruction_writable_decrement_rule> {
 		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			std::cout << "saw a Instruction_writable_decrement_rule |" << in.string() << "|" << std::endl;
+		static void apply(const Input &in, ParseState &state) {
+			auto i = state.program.arena.make<Instruction_decrement>();
+			i->destination = state.pop_operand();
+			state.add_instruction(i);
 		}
 	};
 
 	template<> struct action<Instruction_leaq_rule> {
 		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			std::cout << "saw a Instruction_leaq_rule |" << in.string() << "|" << std::endl;
+		static void apply(const Input &in, ParseState &state) {
+			auto i = state.program.arena.make<Instruction_lea>();
+			i->scale = state.pop_operand().value;
+			i->index = state.pop_operand();
+			i->base = state.pop_operand();
+			i->destination = state.pop_operand();
+			state.add_instruction(i);
 		}
 	};
 
-	template<> struct action<Instruction_rule> {
-		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			std::cout << "saw a Instruction_rule |" << in.string() << "|" << std::endl;
-		}
-	};
-
-	template<> struct action<Instructions_rule> {
-		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			std::cout << "saw a Instructions_rule |" << in.string() << "|" << std::endl;
-		}
-	};
-
-	template<> struct action<Function_rule> {
-		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			std::cout << "saw a Function_rule |" << in.string() << "|" << std::endl;
-		}
-	};
+#ifdef L1_GRAMMAR_CHECK
+	/*
+	 * The grammar is fixed at compile time, so checking it for possible
+	 * issues is done once by `make grammar_check` rather than on every parse.
+	 */
+	size_t analyze_grammar() {
+		return pegtl::analyze<grammar>();
+	}
+#endif
+
+	bool parser_kind_from_string(const char *name, ParserKind &kind) {
+		if (strcmp(name, "pegtl") == 0) {
+			kind = ParserKind::pegtl;
+		} else if (strcmp(name, "handwritten") == 0) {
+			kind = ParserKind::handwritten;
+		} else if (strcmp(name, "parallel") == 0) {
+			kind = ParserKind::parallel;
+		} else {
+			return false;
+		}
+		return true;
+	}
 
-	template<> struct action<Functions_rule> {
-		template<typename Input>
-		static void apply(const Input &in, Program &p) {
-			std::cout << "saw a Functions_rule |" << in.string() << "|" << std::endl;
+	Program parse_file(char *fileName, ParserKind kind, unsigned num_threads) {
+		if (kind == ParserKind::handwritten) {
+			return parse_file_handwritten(fileName);
 		}
-	};
-
-	Program parse_file(char *fileName) {
-
-		/*
-		 * Check the grammar for some possible issues.
-		 */
-		if (pegtl::analyze<grammar>() != 0) {
-			std::cerr << "There are problems with the grammar" << std::endl;
-			exit(1);
+		if (kind == ParserKind::parallel) {
+			return parse_file_parallel(fileName, num_threads);
 		}
 
 		/*
 		 * Parse.
+		 * The file is mapped rather than read, and the actions only look at
+		 * views of the mapped bytes, so tokens are never copied.
 		 */
-		file_input<> fileInput(fileName);
+		mmap_input<> fileInput(fileName);
 		Program p;
-		parse<grammar, action>(fileInput, p);
-
-		for (Item *item : parsed_items) {
-			std::cout << item->toString() << "\n";
-		}
+		ParseState state(p);
+		parse<grammar, action>(fileInput, state);
 
 		return p;
 	}
+
+	void parse_file_streaming(char *fileName, SymbolTable &symbols, const EntryPointCallback &on_entry_point, const FunctionCallback &on_function) {
+		parse_file_streaming_handwritten(fileName, symbols, on_entry_point, on_function);
+	}
 }
@@ -1,7 +1,37 @@
 #pragma once
 
+#include <functional>
+
 #include <L1.h>
 
 namespace L1{
-	Program parse_file (char *fileName);
+	enum struct ParserKind {
+		pegtl, // the PEGTL grammar in parser.cpp
+		handwritten, // the recursive-descent parser in handwritten_parser.cpp
+		parallel // the recursive-descent parser, one function per task on a thread pool
+	};
+
+	// "pegtl", "handwritten", or "parallel"; returns false for any other name
+	bool parser_kind_from_string(const char *name, ParserKind &kind);
+
+	// num_threads is only used by ParserKind::parallel; 0 means one per core
+	Program parse_file (char *fileName, ParserKind kind = ParserKind::pegtl, unsigned num_threads = 0);
+
+	using EntryPointCallback = std::function<void(SymbolID entryPointLabel, const SymbolTable &symbols)>;
+	using FunctionCallback = std::function<void(Function &f, const SymbolTable &symbols)>;
+
+	/*
+	 * Parses the file one function at a time instead of building a Program.
+	 * on_entry_point is called once the entry point is known, then
+	 * on_function right after each function's closing ')'. A function only
+	 * lives until on_function returns, so memory use is bounded by the
+	 * largest function rather than the whole program. Names are interned in
+	 * `symbols`, which outlives the parse. Uses the hand-written parser.
+	 */
+	void parse_file_streaming (char *fileName, SymbolTable &symbols, const EntryPointCallback &on_entry_point, const FunctionCallback &on_function);
+
+#ifdef L1_GRAMMAR_CHECK
+	// returns the number of issues found in the grammar
+	size_t analyze_grammar();
+#endif
 }
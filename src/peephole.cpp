@@ -0,0 +1,256 @@
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <cfg.h>
+#include <peephole.h>
+
+namespace L1 {
+	// the exponent if `value` is 2^k with k > 0, otherwise -1
+	static int64_t power_of_two_exponent(int64_t value) {
+		if (value <= 1 || (value & (value - 1)) != 0) {
+			return -1;
+		}
+		int64_t exponent = 0;
+		while (value > 1) {
+			value >>= 1;
+			exponent++;
+		}
+		return exponent;
+	}
+
+	/*
+	 * The instruction that does the same as the visited one on its own: the
+	 * instruction itself, a cheaper replacement, or nullptr if it does
+	 * nothing.
+	 */
+	struct SimplifyVisitor : InstructionVisitor {
+		Arena &arena;
+		Instruction *result = nullptr;
+
+		SimplifyVisitor(Arena &arena) : arena {arena} {}
+
+		virtual void visit(Instruction_ret &i) override {
+			this->result = &i;
+		}
+
+		virtual void visit(Instruction_assignment &i) override {
+			bool self_move = i.destination.kind == OperandKind::reg && i.source.kind == OperandKind::reg && i.source.reg == i.destination.reg;
+			this->result = self_move ? nullptr : &i;
+		}
+
+		virtual void visit(Instruction_arithmetic &i) override {
+			this->result = &i;
+			if (i.source.kind != OperandKind::number) {
+				return;
+			}
+			int64_t n = i.source.value;
+			switch (i.op) {
+				case Operator::plus:
+				case Operator::minus:
+					if (n == 0) {
+						this->result = nullptr;
+					}
+					break;
+				case Operator::times: {
+					if (n == 1) {
+						this->result = nullptr;
+						break;
+					}
+					int64_t exponent = power_of_two_exponent(n);
+					if (exponent < 0) {
+						break;
+					}
+					auto shift = this->arena.make<Instruction_shift>();
+					shift->op = Operator::lshift;
+					shift->source = Operand::make_number(exponent);
+					shift->destination = i.destination;
+					this->result = shift;
+					break;
+				}
+				case Operator::bitwise_and:
+					if (n == -1) {
+						this->result = nullptr;
+					}
+					break;
+				default:
+					break;
+			}
+		}
+
+		virtual void visit(Instruction_shift &i) override {
+			bool by_zero = i.source.kind == OperandKind::number && i.source.value == 0;
+			this->result = by_zero ? nullptr : &i;
+		}
+
+		virtual void visit(Instruction_compare_assignment &i) override {
+			this->result = &i;
+		}
+
+		virtual void visit(Instruction_cjump &i) override {
+			this->result = &i;
+		}
+
+		virtual void visit(Instruction_label &i) override {
+			this->result = &i;
+		}
+
+		virtual void visit(Instruction_goto &i) override {
+			this->result = &i;
+		}
+
+		virtual void visit(Instruction_call &i) override {
+			this->result = &i;
+		}
+
+		virtual void visit(Instruction_call_runtime &i) override {
+			this->result = &i;
+		}
+
+		virtual void visit(Instruction_increment &i) override {
+			this->result = &i;
+		}
+
+		virtual void visit(Instruction_decrement &i) override {
+			this->result = &i;
+		}
+
+		virtual void visit(Instruction_lea &i) override {
+			this->result = &i;
+		}
+	};
+
+	static ControlFlowVisitor control_flow(Instruction *i) {
+		ControlFlowVisitor v;
+		i->accept(v);
+		return v;
+	}
+
+	/*
+	 * Sends every jump to a label followed by "goto :next" straight to
+	 * :next, following chains of gotos. Returns whether anything changed.
+	 */
+	static bool retarget_goto_chains(std::vector<Instruction *> &instructions) {
+		std::unordered_map<SymbolID, std::size_t> label_indices;
+		for (std::size_t k = 0; k < instructions.size(); k++) {
+			if (Operand *label = control_flow(instructions[k]).label) {
+				label_indices[label->symbol] = k;
+			}
+		}
+
+		// what the first instruction that isn't a label at or after `label` does, if there is one
+		auto code_at = [&](SymbolID label) -> ControlFlowVisitor {
+			auto found = label_indices.find(label);
+			if (found == label_indices.end()) {
+				return {};
+			}
+			for (std::size_t k = found->second; k < instructions.size(); k++) {
+				ControlFlowVisitor v = control_flow(instructions[k]);
+				if (!v.label) {
+					return v;
+				}
+			}
+			return {};
+		};
+
+		bool changed = false;
+		for (Instruction *i : instructions) {
+			Operand *target = control_flow(i).target;
+			if (!target) {
+				continue;
+			}
+			SymbolID label = target->symbol;
+			std::unordered_set<SymbolID> visited = {label};
+			for (ControlFlowVisitor next = code_at(label); next.target && !next.falls_through; next = code_at(label)) {
+				// a goto
+				if (!visited.insert(next.target->symbol).second) {
+					break; // an infinite loop of gotos
+				}
+				label = next.target->symbol;
+			}
+			if (label != target->symbol) {
+				target->symbol = label;
+				changed = true;
+			}
+		}
+		return changed;
+	}
+
+	/*
+	 * Drops everything between a "return", a "goto", or a call to
+	 * tuple-error or tensor-error and the next label.
+	 */
+	static bool remove_unreachable(std::vector<Instruction *> &instructions) {
+		bool reachable = true;
+		auto end = std::remove_if(instructions.begin(), instructions.end(), [&reachable](Instruction *i) {
+			ControlFlowVisitor v = control_flow(i);
+			if (v.label) {
+				reachable = true;
+				return false;
+			}
+			bool remove = !reachable;
+			if (!v.falls_through) {
+				reachable = false;
+			}
+			return remove;
+		});
+		bool changed = end != instructions.end();
+		instructions.erase(end, instructions.end());
+		return changed;
+	}
+
+	// drops jumps to a label that directly follows them
+	static bool remove_jumps_to_next(std::vector<Instruction *> &instructions) {
+		std::vector<Instruction *> kept;
+		kept.reserve(instructions.size());
+		for (std::size_t k = 0; k < instructions.size(); k++) {
+			if (Operand *target = control_flow(instructions[k]).target) {
+				bool next = false;
+				for (std::size_t j = k + 1; j < instructions.size(); j++) {
+					Operand *label = control_flow(instructions[j]).label;
+					if (!label) {
+						break;
+					}
+					if (label->symbol == target->symbol) {
+						next = true;
+						break;
+					}
+				}
+				if (next) {
+					continue;
+				}
+			}
+			kept.push_back(instructions[k]);
+		}
+		bool changed = kept.size() != instructions.size();
+		instructions = std::move(kept);
+		return changed;
+	}
+
+	std::size_t peephole_optimize(Function &f, Arena &arena) {
+		std::vector<Instruction *> &instructions = f.instructions;
+		std::size_t original_size = instructions.size();
+
+		std::vector<Instruction *> simplified;
+		simplified.reserve(instructions.size());
+		for (Instruction *i : instructions) {
+			SimplifyVisitor v(arena);
+			i->accept(v);
+			if (v.result) {
+				simplified.push_back(v.result);
+			}
+		}
+		instructions = std::move(simplified);
+
+		// each of these can open up opportunities for the others
+		bool changed = true;
+		while (changed) {
+			changed = retarget_goto_chains(instructions);
+			changed |= remove_unreachable(instructions);
+			changed |= remove_jumps_to_next(instructions);
+		}
+
+		return original_size - instructions.size();
+	}
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+
+#include <L1.h>
+
+namespace L1 {
+	/*
+	 * The -O1 pass: local cleanups of one function's instructions.
+	 *
+	 * Removes self-moves, additions, subtractions and shifts of 0 and
+	 * multiplications by 1, and turns multiplications by other powers of 2
+	 * into shifts. Jumps to a "goto" are sent straight to its target, jumps
+	 * to the label right after them are removed, and so is everything
+	 * between a "return", a "goto", or a call to tuple-error or
+	 * tensor-error and the next label.
+	 *
+	 * New instructions are allocated in `arena`. Labels are never removed,
+	 * since their addresses may be taken anywhere in the program. Returns
+	 * the number of instructions removed.
+	 */
+	std::size_t peephole_optimize(Function &f, Arena &arena);
+}
@@ -0,0 +1,109 @@
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include <profile.h>
+
+namespace L1 {
+	std::vector<std::size_t> profiled_branches(const Function &f, const ControlFlowGraph &cfg) {
+		std::vector<std::size_t> branches;
+		for (std::size_t b = 0; b < cfg.blocks.size(); b++) {
+			if (dynamic_cast<const Instruction_cjump *>(f.instructions[cfg.blocks[b].end - 1])) {
+				branches.push_back(b);
+			}
+		}
+		return branches;
+	}
+
+	// reads the little-endian integers of a profile, and throws past its end
+	struct ProfileReader {
+		const std::string &fileName;
+		const std::vector<char> &data;
+		std::size_t offset;
+
+		uint64_t number(std::size_t size) {
+			this->need(size);
+			uint64_t value = 0;
+			for (std::size_t i = 0; i < size; i++) {
+				value |= uint64_t(static_cast<unsigned char>(this->data[this->offset + i])) << (8 * i);
+			}
+			this->offset += size;
+			return value;
+		}
+
+		std::string string(std::size_t size) {
+			this->need(size);
+			std::string s(&this->data[this->offset], size);
+			this->offset += size;
+			return s;
+		}
+
+		void need(std::size_t size) {
+			if (size > this->data.size() - this->offset) {
+				throw std::runtime_error(this->fileName + " is cut short");
+			}
+		}
+	};
+
+	// Profile methods
+
+	Profile::Profile(const std::string &fileName) {
+		std::ifstream file(fileName, std::ios::binary);
+		if (!file) {
+			throw std::runtime_error("can't read " + fileName);
+		}
+		std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		std::size_t magic_size = sizeof(magic) - 1;
+		if (data.size() < magic_size || std::memcmp(data.data(), magic, magic_size) != 0) {
+			throw std::runtime_error(fileName + " isn't an L1 profile");
+		}
+
+		ProfileReader reader {fileName, data, magic_size};
+		uint64_t num_functions = reader.number(8);
+		std::vector<Counts *> order;
+		for (uint64_t i = 0; i < num_functions; i++) {
+			std::size_t name_size = reader.number(4);
+			Counts counts;
+			counts.num_instructions = reader.number(4);
+			counts.blocks.resize(reader.number(4));
+			counts.branches.resize(reader.number(4));
+			std::string name = reader.string(name_size);
+			order.push_back(&(this->functions[name] = std::move(counts)));
+		}
+		reader.offset = (reader.offset + 7) / 8 * 8;
+		for (Counts *counts : order) {
+			for (uint64_t &count : counts->blocks) {
+				count = reader.number(8);
+			}
+			for (uint64_t &count : counts->branches) {
+				count = reader.number(8);
+			}
+		}
+	}
+
+	bool Profile::find(const Function &f, const ControlFlowGraph &cfg, const SymbolTable &symbols, FunctionProfile &profile) const {
+		auto found = this->functions.find(symbols.name(f.name));
+		if (found == this->functions.end()) {
+			return false;
+		}
+		const Counts &counts = found->second;
+		std::vector<std::size_t> branches = profiled_branches(f, cfg);
+		if (counts.num_instructions != f.instructions.size() || counts.blocks.size() != cfg.blocks.size() || counts.branches.size() != branches.size()) {
+			return false;
+		}
+
+		// every other block that falls through does so every time it runs
+		profile.blocks = counts.blocks;
+		profile.fell_through.assign(cfg.blocks.size(), 0);
+		for (std::size_t b = 0; b < cfg.blocks.size(); b++) {
+			if (cfg.blocks[b].falls_through) {
+				profile.fell_through[b] = counts.blocks[b];
+			}
+		}
+		for (std::size_t i = 0; i < branches.size(); i++) {
+			profile.fell_through[branches[i]] = counts.branches[i];
+		}
+		return true;
+	}
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <L1.h>
+#include <cfg.h>
+
+namespace L1 {
+	/*
+	 * How often the blocks of one function ran, with the blocks of its
+	 * ControlFlowGraph.
+	 */
+	struct FunctionProfile {
+		// how many times each block ran
+		std::vector<uint64_t> blocks;
+
+		// how many times each block went on to the block after it in the function
+		std::vector<uint64_t> fell_through;
+	};
+
+	/*
+	 * The blocks that end in a cjump, in order. A program compiled with
+	 * -fprofile-generate counts how many times each block runs, and how
+	 * many times each of these falls through.
+	 */
+	std::vector<std::size_t> profiled_branches(const Function &f, const ControlFlowGraph &cfg);
+
+	/*
+	 * The counts a program compiled with -fprofile-generate writes to
+	 * prog.profile when it exits, all little-endian:
+	 *
+	 *   "L1PROF01"
+	 *   uint64   number of functions
+	 *   for each function:
+	 *     uint32 length of its name, then instructions, blocks, branches
+	 *     its name
+	 *   zeros up to a multiple of 8 bytes
+	 *   for each function:
+	 *     uint64 one count per block, then one per branch
+	 *
+	 * where branches are the profiled_branches of the function as it was
+	 * compiled (after the passes of its -O level).
+	 */
+	class Profile {
+		public:
+
+		static constexpr char magic[] = "L1PROF01";
+
+		// throws if the file can't be read or isn't a profile
+		Profile(const std::string &fileName);
+
+		/*
+		 * The counts of f, unless the profile has none or they were taken
+		 * from different code: when the program or the -O level changed
+		 * since it was profiled.
+		 */
+		bool find(const Function &f, const ControlFlowGraph &cfg, const SymbolTable &symbols, FunctionProfile &profile) const;
+
+		private:
+
+		struct Counts {
+			std::size_t num_instructions;
+			std::vector<uint64_t> blocks;
+			std::vector<uint64_t> branches;
+		};
+
+		std::unordered_map<std::string, Counts> functions;
+	};
+}
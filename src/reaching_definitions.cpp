@@ -0,0 +1,73 @@
+#include <utility>
+
+#include <dataflow.h>
+#include <liveness.h>
+#include <reaching_definitions.h>
+
+namespace L1 {
+	using Definitions = ReachingDefinitions::Definitions;
+
+	static Definitions all(uint32_t definition) {
+		Definitions d;
+		d.fill(definition);
+		return d;
+	}
+
+	/*
+	 * Reaching definitions as a forward problem, with each block summarized
+	 * as the last instruction in it that writes each register (none if no
+	 * instruction does).
+	 */
+	struct ReachingDefinitionsProblem {
+		using Set = Definitions;
+
+		Direction direction = Direction::forward;
+		std::vector<Definitions> last_writes;
+
+		Set initial() const {
+			return all(ReachingDefinitions::none);
+		}
+
+		Set boundary() const {
+			return all(ReachingDefinitions::entry);
+		}
+
+		void join(Set &into, const Set &from) const {
+			for (std::size_t r = 0; r < into.size(); r++) {
+				uint32_t a = into[r];
+				uint32_t b = from[r];
+				into[r] = a == ReachingDefinitions::none ? b : b == ReachingDefinitions::none || b == a ? a : ReachingDefinitions::several;
+			}
+		}
+
+		void transfer(std::size_t b, Set &s) const {
+			const Definitions &last = this->last_writes[b];
+			for (std::size_t r = 0; r < s.size(); r++) {
+				s[r] = last[r] != ReachingDefinitions::none ? last[r] : s[r];
+			}
+		}
+	};
+
+	// ReachingDefinitions methods
+
+	ReachingDefinitions::ReachingDefinitions(const Function &f, const ControlFlowGraph &cfg) {
+		ReachingDefinitionsProblem problem;
+		problem.last_writes.reserve(cfg.blocks.size());
+		for (const BasicBlock &block : cfg.blocks) {
+			Definitions last = all(none);
+			for (std::size_t k = block.begin; k < block.end; k++) {
+				step(f, k, last);
+			}
+			problem.last_writes.push_back(last);
+		}
+		DataflowSolution<Definitions> solution = solve(cfg, problem);
+		this->in = std::move(solution.in);
+		this->out = std::move(solution.out);
+	}
+
+	void ReachingDefinitions::step(const Function &f, std::size_t k, Definitions &d) {
+		for (unsigned writes = register_effects(f.instructions[k]).writes; writes != 0; writes &= writes - 1) {
+			d[__builtin_ctz(writes)] = static_cast<uint32_t>(k);
+		}
+	}
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <L1.h>
+#include <cfg.h>
+
+namespace L1 {
+	/*
+	 * Reaching definitions: for every register at the start and the end of
+	 * every block, the instruction (an index into f.instructions) whose
+	 * write produced the value the register holds there.
+	 *
+	 * Each register has a single slot, so where writes by different
+	 * instructions can reach, the slot only records that there are several.
+	 * The sets stay at 64 bytes per block however long the function is,
+	 * where sets of all the definitions that reach would grow with the
+	 * number of blocks times the number of instructions.
+	 */
+	struct ReachingDefinitions {
+		// one slot per RegisterID
+		using Definitions = std::array<uint32_t, 16>;
+
+		// the value the register had when the function was called
+		static constexpr uint32_t entry = UINT32_MAX - 2;
+		// writes by several instructions (or the entry value and a write) reach
+		static constexpr uint32_t several = UINT32_MAX - 1;
+		// nothing reaches: the block can't be reached from the entry
+		static constexpr uint32_t none = UINT32_MAX;
+
+		std::vector<Definitions> in;
+		std::vector<Definitions> out;
+
+		ReachingDefinitions(const Function &f, const ControlFlowGraph &cfg);
+
+		// updates `d` from before f.instructions[k] to after it
+		static void step(const Function &f, std::size_t k, Definitions &d);
+	};
+}
@@ -0,0 +1,108 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cinttypes>
+
+#include <runtime.h>
+
+namespace L1 {
+	// nested arrays are only printed this deep
+	static const int max_print_depth = 4;
+
+	static int64_t decode(int64_t value) {
+		return value >> 1;
+	}
+
+	static void print_content(int64_t value, int depth) {
+		if (value & 1) {
+			std::printf("%" PRId64, decode(value));
+			return;
+		}
+		if (depth >= max_print_depth) {
+			std::printf("...");
+			return;
+		}
+		const int64_t *array = reinterpret_cast<const int64_t *>(value);
+		int64_t length = array[0];
+		std::printf("{s:%" PRId64, length);
+		for (int64_t i = 1; i <= length; i++) {
+			std::printf(", ");
+			print_content(array[i], depth + 1);
+		}
+		std::printf("}");
+	}
+
+	int64_t runtime_print(int64_t value) {
+		print_content(value, 0);
+		std::printf("\n");
+		return 1;
+	}
+
+	int64_t runtime_input() {
+		int64_t value;
+		if (std::scanf("%" SCNd64, &value) != 1) {
+			std::fprintf(stderr, "input: no integer to read\n");
+			std::exit(-1);
+		}
+		return (value << 1) | 1;
+	}
+
+	int64_t runtime_allocate(int64_t encoded_size, int64_t fill) {
+		if (!(encoded_size & 1)) {
+			std::printf("allocate called with a size that is not an encoded integer, %" PRId64 "\n", encoded_size);
+			std::exit(-1);
+		}
+		int64_t size = decode(encoded_size);
+		if (size < 0) {
+			std::printf("allocate called with a negative size, %" PRId64 "\n", size);
+			std::exit(-1);
+		}
+		int64_t *array = static_cast<int64_t *>(std::malloc((size + 1) * sizeof(int64_t)));
+		if (!array) {
+			std::printf("allocate: out of memory\n");
+			std::exit(-1);
+		}
+		array[0] = size;
+		for (int64_t i = 1; i <= size; i++) {
+			array[i] = fill;
+		}
+		return reinterpret_cast<int64_t>(array);
+	}
+
+	void runtime_tuple_error(int64_t array, int64_t length, int64_t index) {
+		std::printf("attempted to use position %" PRId64 " in a tuple that only has %" PRId64 " positions\n", decode(index), decode(length));
+		std::exit(-1);
+	}
+
+	void runtime_tensor_error_null(int64_t line) {
+		std::printf("attempted to use a zero-initialized variable as a tensor (line %" PRId64 ")\n", decode(line));
+		std::exit(-1);
+	}
+
+	void runtime_tensor_error(int64_t line, int64_t length, int64_t index) {
+		std::printf("attempted to use position %" PRId64 " in an array that only has %" PRId64 " positions (line %" PRId64 ")\n", decode(index), decode(length), decode(line));
+		std::exit(-1);
+	}
+
+	void runtime_tensor_error_dimension(int64_t line, int64_t dimension, int64_t length, int64_t index) {
+		std::printf("attempted to use position %" PRId64 " of dimension %" PRId64 ", which only has %" PRId64 " positions (line %" PRId64 ")\n", decode(index), decode(dimension), decode(length), decode(line));
+		std::exit(-1);
+	}
+
+	void *runtime_function_address(RuntimeFunction function, int64_t num_arguments) {
+		switch (function) {
+			case RuntimeFunction::print: return reinterpret_cast<void *>(&runtime_print);
+			case RuntimeFunction::input: return reinterpret_cast<void *>(&runtime_input);
+			case RuntimeFunction::allocate: return reinterpret_cast<void *>(&runtime_allocate);
+			case RuntimeFunction::tuple_error: return reinterpret_cast<void *>(&runtime_tuple_error);
+			case RuntimeFunction::tensor_error:
+				if (num_arguments == 1) {
+					return reinterpret_cast<void *>(&runtime_tensor_error_null);
+				}
+				if (num_arguments == 3) {
+					return reinterpret_cast<void *>(&runtime_tensor_error);
+				}
+				return reinterpret_cast<void *>(&runtime_tensor_error_dimension);
+		}
+		return nullptr;
+	}
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+
+#include <L1.h>
+
+namespace L1 {
+	/*
+	 * The L1 runtime, linked into the process for the JIT.
+	 * Values follow the L1 encoding: integers are (n << 1) | 1 and anything
+	 * else is a pointer to an array whose first word is its length.
+	 */
+	int64_t runtime_print(int64_t value);
+	int64_t runtime_input();
+	int64_t runtime_allocate(int64_t encoded_size, int64_t fill);
+	void runtime_tuple_error(int64_t array, int64_t length, int64_t index);
+	void runtime_tensor_error_null(int64_t line);
+	void runtime_tensor_error(int64_t line, int64_t length, int64_t index);
+	void runtime_tensor_error_dimension(int64_t line, int64_t dimension, int64_t length, int64_t index);
+
+	// address of the function implementing "call function num_arguments"
+	void *runtime_function_address(RuntimeFunction function, int64_t num_arguments);
+}
@@ -0,0 +1,23 @@
+#include <symbol_table.h>
+
+namespace L1 {
+	SymbolID SymbolTable::intern(std::string_view name) {
+		auto it = this->ids.find(name);
+		if (it != this->ids.end()) {
+			return it->second;
+		}
+
+		SymbolID id = static_cast<SymbolID>(this->names.size());
+		this->names.emplace_back(name);
+		this->ids.emplace(this->names.back(), id);
+		return id;
+	}
+
+	const std::string &SymbolTable::name(SymbolID id) const {
+		return this->names[id];
+	}
+
+	std::size_t SymbolTable::size() const {
+		return this->names.size();
+	}
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace L1 {
+
+	// Dense id of an interned label or function name; valid ids are [0, size())
+	using SymbolID = uint32_t;
+
+	/*
+	 * Interns the label and function names of a Program.
+	 * Each distinct name is stored once and identified by a dense id, so
+	 * names compare as integers and per-name data can live in a plain vector
+	 * indexed by SymbolID.
+	 */
+	class SymbolTable {
+		public:
+
+		SymbolID intern(std::string_view name);
+
+		const std::string &name(SymbolID id) const;
+
+		std::size_t size() const;
+
+		private:
+
+		// a deque never moves its elements, so the views used as keys stay valid
+		std::deque<std::string> names;
+		std::unordered_map<std::string_view, SymbolID> ids;
+	};
+}
@@ -0,0 +1,313 @@
+#include <x86_encoder.h>
+
+namespace L1 {
+	// hardware number of each RegisterID
+	static const uint8_t register_numbers[] = {
+		0, 3, 1, 2, 7, 6, 8, 9,
+		10, 11, 12, 13, 14, 15, 5, 4
+	};
+
+	static uint8_t number(RegisterID id) {
+		return register_numbers[static_cast<int>(id)];
+	}
+
+	static bool fits_in_int8(int64_t value) {
+		return value >= INT8_MIN && value <= INT8_MAX;
+	}
+
+	// X86Encoder methods
+
+	void X86Encoder::imm32(int32_t value) {
+		uint32_t v = static_cast<uint32_t>(value);
+		for (int i = 0; i < 4; i++) {
+			this->byte(v >> (8 * i));
+		}
+	}
+
+	void X86Encoder::imm64(int64_t value) {
+		uint64_t v = static_cast<uint64_t>(value);
+		for (int i = 0; i < 8; i++) {
+			this->byte(v >> (8 * i));
+		}
+	}
+
+	void X86Encoder::rex(bool w, uint8_t reg, uint8_t rm, bool force) {
+		uint8_t prefix = 0x40 | (w << 3) | ((reg >> 3) << 2) | (rm >> 3);
+		if (prefix != 0x40 || force) {
+			this->byte(prefix);
+		}
+	}
+
+	void X86Encoder::modrm_register(uint8_t reg, uint8_t rm) {
+		this->byte(0xc0 | ((reg & 7) << 3) | (rm & 7));
+	}
+
+	void X86Encoder::modrm_memory(uint8_t reg, Memory m) {
+		uint8_t base = number(m.base);
+		uint8_t mod;
+		// [rbp] and [r13] have no encoding without a displacement
+		if (m.displacement == 0 && (base & 7) != 5) {
+			mod = 0;
+		} else if (fits_in_int8(m.displacement)) {
+			mod = 1;
+		} else {
+			mod = 2;
+		}
+		this->byte((mod << 6) | ((reg & 7) << 3) | (base & 7));
+		// rsp and r12 as a base need a SIB byte
+		if ((base & 7) == 4) {
+			this->byte(0x24);
+		}
+		if (mod == 1) {
+			this->byte(static_cast<int8_t>(m.displacement));
+		} else if (mod == 2) {
+			this->imm32(m.displacement);
+		}
+	}
+
+	void X86Encoder::mov(RegisterID destination, RegisterID source) {
+		this->rex(true, number(source), number(destination));
+		this->byte(0x89);
+		this->modrm_register(number(source), number(destination));
+	}
+
+	void X86Encoder::mov(RegisterID destination, Memory source) {
+		this->rex(true, number(destination), number(source.base));
+		this->byte(0x8b);
+		this->modrm_memory(number(destination), source);
+	}
+
+	void X86Encoder::mov(Memory destination, RegisterID source) {
+		this->rex(true, number(source), number(destination.base));
+		this->byte(0x89);
+		this->modrm_memory(number(source), destination);
+	}
+
+	void X86Encoder::mov(RegisterID destination, int64_t value) {
+		if (fits_in_int32(value)) {
+			this->rex(true, 0, number(destination));
+			this->byte(0xc7);
+			this->modrm_register(0, number(destination));
+			this->imm32(value);
+		} else {
+			this->rex(true, 0, number(destination));
+			this->byte(0xb8 | (number(destination) & 7));
+			this->imm64(value);
+		}
+	}
+
+	std::size_t X86Encoder::mov(Memory destination, int32_t value) {
+		this->rex(true, 0, number(destination.base));
+		this->byte(0xc7);
+		this->modrm_memory(0, destination);
+		std::size_t offset = this->size();
+		this->imm32(value);
+		return offset;
+	}
+
+	std::size_t X86Encoder::lea_rip(RegisterID destination) {
+		this->rex(true, number(destination), 0);
+		this->byte(0x8d);
+		this->byte(((number(destination) & 7) << 3) | 5);
+		std::size_t offset = this->size();
+		this->imm32(0);
+		return offset;
+	}
+
+	void X86Encoder::lea(RegisterID destination, RegisterID base, RegisterID index, int64_t scale) {
+		uint8_t d = number(destination);
+		uint8_t b = number(base);
+		uint8_t x = number(index);
+		uint8_t scale_bits = scale == 8 ? 3 : scale == 4 ? 2 : scale == 2 ? 1 : 0;
+		this->byte(0x48 | ((d >> 3) << 2) | ((x >> 3) << 1) | (b >> 3));
+		this->byte(0x8d);
+		// [rbp + ...] and [r13 + ...] need an explicit zero displacement
+		bool needs_displacement = (b & 7) == 5;
+		this->byte(((needs_displacement ? 1 : 0) << 6) | ((d & 7) << 3) | 4);
+		this->byte((scale_bits << 6) | ((x & 7) << 3) | (b & 7));
+		if (needs_displacement) {
+			this->byte(0);
+		}
+	}
+
+	void X86Encoder::alu(AluOp op, RegisterID destination, RegisterID source) {
+		this->rex(true, number(source), number(destination));
+		this->byte(static_cast<uint8_t>(op) * 8 + 1);
+		this->modrm_register(number(source), number(destination));
+	}
+
+	void X86Encoder::alu(AluOp op, RegisterID destination, Memory source) {
+		this->rex(true, number(destination), number(source.base));
+		this->byte(static_cast<uint8_t>(op) * 8 + 3);
+		this->modrm_memory(number(destination), source);
+	}
+
+	void X86Encoder::alu(AluOp op, Memory destination, RegisterID source) {
+		this->rex(true, number(source), number(destination.base));
+		this->byte(static_cast<uint8_t>(op) * 8 + 1);
+		this->modrm_memory(number(source), destination);
+	}
+
+	void X86Encoder::alu(AluOp op, RegisterID destination, int32_t value) {
+		// rax has a shorter form for 32-bit immediates
+		if (destination == RegisterID::rax && !fits_in_int8(value)) {
+			this->byte(0x48);
+			this->byte(static_cast<uint8_t>(op) * 8 + 5);
+			this->imm32(value);
+			return;
+		}
+		this->rex(true, 0, number(destination));
+		this->byte(fits_in_int8(value) ? 0x83 : 0x81);
+		this->modrm_register(static_cast<uint8_t>(op), number(destination));
+		if (fits_in_int8(value)) {
+			this->byte(static_cast<int8_t>(value));
+		} else {
+			this->imm32(value);
+		}
+	}
+
+	void X86Encoder::alu(AluOp op, Memory destination, int32_t value) {
+		this->rex(true, 0, number(destination.base));
+		this->byte(fits_in_int8(value) ? 0x83 : 0x81);
+		this->modrm_memory(static_cast<uint8_t>(op), destination);
+		if (fits_in_int8(value)) {
+			this->byte(static_cast<int8_t>(value));
+		} else {
+			this->imm32(value);
+		}
+	}
+
+	void X86Encoder::imul(RegisterID destination, RegisterID source) {
+		this->rex(true, number(destination), number(source));
+		this->byte(0x0f);
+		this->byte(0xaf);
+		this->modrm_register(number(destination), number(source));
+	}
+
+	void X86Encoder::imul(RegisterID destination, int32_t value) {
+		this->rex(true, number(destination), number(destination));
+		this->byte(fits_in_int8(value) ? 0x6b : 0x69);
+		this->modrm_register(number(destination), number(destination));
+		if (fits_in_int8(value)) {
+			this->byte(static_cast<int8_t>(value));
+		} else {
+			this->imm32(value);
+		}
+	}
+
+	void X86Encoder::shift(ShiftOp op, RegisterID destination) {
+		this->rex(true, 0, number(destination));
+		this->byte(0xd3);
+		this->modrm_register(static_cast<uint8_t>(op), number(destination));
+	}
+
+	void X86Encoder::shift(ShiftOp op, RegisterID destination, uint8_t count) {
+		this->rex(true, 0, number(destination));
+		this->byte(0xc1);
+		this->modrm_register(static_cast<uint8_t>(op), number(destination));
+		this->byte(count);
+	}
+
+	void X86Encoder::inc(RegisterID destination) {
+		this->rex(true, 0, number(destination));
+		this->byte(0xff);
+		this->modrm_register(0, number(destination));
+	}
+
+	void X86Encoder::dec(RegisterID destination) {
+		this->rex(true, 0, number(destination));
+		this->byte(0xff);
+		this->modrm_register(1, number(destination));
+	}
+
+	void X86Encoder::setcc(Condition condition, RegisterID destination) {
+		// without a REX prefix, 4-7 would mean ah, ch, dh, and bh
+		uint8_t d = number(destination);
+		this->rex(false, 0, d, d >= 4);
+		this->byte(0x0f);
+		this->byte(0x90 | static_cast<uint8_t>(condition));
+		this->modrm_register(0, d);
+	}
+
+	void X86Encoder::movzx8(RegisterID destination, RegisterID source) {
+		this->rex(true, number(destination), number(source));
+		this->byte(0x0f);
+		this->byte(0xb6);
+		this->modrm_register(number(destination), number(source));
+	}
+
+	std::size_t X86Encoder::jcc(Condition condition) {
+		this->byte(0x0f);
+		this->byte(0x80 | static_cast<uint8_t>(condition));
+		std::size_t offset = this->size();
+		this->imm32(0);
+		return offset;
+	}
+
+	std::size_t X86Encoder::jmp() {
+		this->byte(0xe9);
+		std::size_t offset = this->size();
+		this->imm32(0);
+		return offset;
+	}
+
+	std::size_t X86Encoder::call() {
+		this->byte(0xe8);
+		std::size_t offset = this->size();
+		this->imm32(0);
+		return offset;
+	}
+
+	void X86Encoder::jmp(RegisterID target) {
+		this->rex(false, 0, number(target));
+		this->byte(0xff);
+		this->modrm_register(4, number(target));
+	}
+
+	void X86Encoder::ret() {
+		this->byte(0xc3);
+	}
+
+	void X86Encoder::align(std::size_t alignment) {
+		// the recommended NOP of each length up to 9 bytes
+		static const uint8_t nops[9][9] = {
+			{0x90},
+			{0x66, 0x90},
+			{0x0f, 0x1f, 0x00},
+			{0x0f, 0x1f, 0x40, 0x00},
+			{0x0f, 0x1f, 0x44, 0x00, 0x00},
+			{0x66, 0x0f, 0x1f, 0x44, 0x00, 0x00},
+			{0x0f, 0x1f, 0x80, 0x00, 0x00, 0x00, 0x00},
+			{0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+			{0x66, 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00}
+		};
+		std::size_t padding = (alignment - this->code.size() % alignment) % alignment;
+		while (padding > 0) {
+			std::size_t n = padding < 9 ? padding : 9;
+			this->code.insert(this->code.end(), nops[n - 1], nops[n - 1] + n);
+			padding -= n;
+		}
+	}
+
+	void X86Encoder::push(RegisterID source) {
+		this->rex(false, 0, number(source));
+		this->byte(0x50 | (number(source) & 7));
+	}
+
+	void X86Encoder::pop(RegisterID destination) {
+		this->rex(false, 0, number(destination));
+		this->byte(0x58 | (number(destination) & 7));
+	}
+
+	void X86Encoder::patch_rel32(std::size_t offset, std::size_t target) {
+		// relative to the end of the field, which ends every instruction using it
+		this->patch32(offset, static_cast<int32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(offset + 4)));
+	}
+
+	void X86Encoder::patch32(std::size_t offset, int32_t value) {
+		uint32_t v = static_cast<uint32_t>(value);
+		for (int i = 0; i < 4; i++) {
+			this->code[offset + i] = v >> (8 * i);
+		}
+	}
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <L1.h>
+
+namespace L1 {
+
+	/*
+	 * Encoder for the subset of x86-64 the code generators need.
+	 * Every operation is 64 bits wide, and memory operands are
+	 * [base + displacement]. Methods that emit a 32-bit field whose value is
+	 * only known later (a jump target, an address) return the offset of
+	 * that field in `code`, to be filled in with patch_rel32 or patch32.
+	 */
+	class X86Encoder {
+		public:
+
+		// condition codes of jCC and setCC
+		enum struct Condition : uint8_t {
+			e = 0x4,
+			ne = 0x5,
+			l = 0xc,
+			ge = 0xd,
+			le = 0xe,
+			g = 0xf
+		};
+
+		// the "/digit" of the group 1 arithmetic instructions
+		enum struct AluOp : uint8_t {
+			add = 0,
+			bitwise_and = 4,
+			sub = 5,
+			cmp = 7
+		};
+
+		// the "/digit" of the group 2 shift instructions
+		enum struct ShiftOp : uint8_t {
+			shl = 4,
+			sar = 7
+		};
+
+		struct Memory {
+			RegisterID base;
+			int32_t displacement;
+		};
+
+		std::vector<uint8_t> code;
+
+		std::size_t size() const {
+			return this->code.size();
+		}
+
+		void mov(RegisterID destination, RegisterID source);
+		void mov(RegisterID destination, Memory source);
+		void mov(Memory destination, RegisterID source);
+		void mov(RegisterID destination, int64_t value);
+		// returns the offset of the immediate
+		std::size_t mov(Memory destination, int32_t value);
+
+		// lea destination, [rip + rel32]; returns the offset of rel32
+		std::size_t lea_rip(RegisterID destination);
+		void lea(RegisterID destination, RegisterID base, RegisterID index, int64_t scale);
+
+		void alu(AluOp op, RegisterID destination, RegisterID source);
+		void alu(AluOp op, RegisterID destination, Memory source);
+		void alu(AluOp op, Memory destination, RegisterID source);
+		void alu(AluOp op, RegisterID destination, int32_t value);
+		void alu(AluOp op, Memory destination, int32_t value);
+
+		void imul(RegisterID destination, RegisterID source);
+		void imul(RegisterID destination, int32_t value);
+
+		// shift by %cl
+		void shift(ShiftOp op, RegisterID destination);
+		void shift(ShiftOp op, RegisterID destination, uint8_t count);
+
+		void inc(RegisterID destination);
+		void dec(RegisterID destination);
+
+		void setcc(Condition condition, RegisterID destination);
+		// movzx from the low byte of source
+		void movzx8(RegisterID destination, RegisterID source);
+
+		// these return the offset of their rel32
+		std::size_t jcc(Condition condition);
+		std::size_t jmp();
+		std::size_t call();
+
+		void jmp(RegisterID target);
+		void ret();
+		// NOPs up to the next multiple of `alignment` (a power of 2)
+		void align(std::size_t alignment);
+		void push(RegisterID source);
+		void pop(RegisterID destination);
+
+		// sets the rel32 at `offset` to reach `target`
+		void patch_rel32(std::size_t offset, std::size_t target);
+		void patch32(std::size_t offset, int32_t value);
+
+		private:
+
+		void byte(uint8_t b) {
+			this->code.push_back(b);
+		}
+
+		void imm32(int32_t value);
+		void imm64(int64_t value);
+
+		// REX prefix for a ModRM with the given reg and rm/base registers
+		void rex(bool w, uint8_t reg, uint8_t rm, bool force = false);
+		void modrm_register(uint8_t reg, uint8_t rm);
+		void modrm_memory(uint8_t reg, Memory m);
+	};
+
+	// fits in a sign-extended 32-bit immediate
+	inline bool fits_in_int32(int64_t value) {
+		return value >= INT32_MIN && value <= INT32_MAX;
+	}
+}